@@ -0,0 +1,273 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <vector>
+#include <new>
+#include <cstring>
+#include <cstddef>
+#include "lightgrep_wrapper.hpp"
+#include "lightgrep_wrapper.h"
+
+// hits are written straight into the caller's lw_c_hit_t array
+static_assert(sizeof(lw_c_hit_t) == sizeof(lw::lw_hit_t),
+              "lw_c_hit_t must match lw::lw_hit_t");
+static_assert(offsetof(lw_c_hit_t, start) == offsetof(lw::lw_hit_t, start),
+              "lw_c_hit_t must match lw::lw_hit_t");
+static_assert(offsetof(lw_c_hit_t, size) == offsetof(lw::lw_hit_t, size),
+              "lw_c_hit_t must match lw::lw_hit_t");
+static_assert(offsetof(lw_c_hit_t, pattern_index) ==
+                              offsetof(lw::lw_hit_t, pattern_index),
+              "lw_c_hit_t must match lw::lw_hit_t");
+static_assert(offsetof(lw_c_hit_t, logical_index) ==
+                              offsetof(lw::lw_hit_t, logical_index),
+              "lw_c_hit_t must match lw::lw_hit_t");
+
+struct lw_c_program {
+  lw::lw_scanner_program_t scanner_program;
+  int pattern_count;
+  bool is_finalized;
+  std::string error;
+  lw_c_program() : scanner_program(), pattern_count(0),
+                   is_finalized(false), error() {
+  }
+};
+
+struct lw_c_scanner {
+  std::vector<lw::lw_hit_t> pending;
+  size_t next;
+
+  // while scanning into the caller's array, whether it overflowed and
+  // the number of hits left in it when the scan call ends
+  bool is_closing;
+  bool is_overflowed;
+  size_t direct_count;
+
+  lw::lw_scanner_t scanner;
+  lw_c_scanner(const lw::lw_scanner_program_t& scanner_program) :
+                   pending(), next(0), is_closing(false),
+                   is_overflowed(false), direct_count(0),
+                   scanner(scanner_program, this) {
+  }
+
+  private:
+  // do not allow copy or assignment
+  lw_c_scanner(const lw_c_scanner&) = delete;
+  lw_c_scanner& operator=(const lw_c_scanner&) = delete;
+};
+
+namespace {
+
+  // collect hits for the caller to take
+  void collect_pending(const lw::lw_hit_t* hits,
+                       const size_t count,
+                       void* p_scanner) {
+    lw_c_scanner_t* scanner(static_cast<lw_c_scanner_t*>(p_scanner));
+    scanner->pending.insert(scanner->pending.end(), hits, hits + count);
+  }
+
+  // receive the hits written into the caller's array.  They stay in
+  // place unless the array fills, in which case every hit of the scan
+  // call is collected for the caller to take in order.
+  void collect_direct(const lw::lw_hit_t* hits,
+                      const size_t count,
+                      void* p_scanner) {
+    lw_c_scanner_t* scanner(static_cast<lw_c_scanner_t*>(p_scanner));
+    if (scanner->is_closing && !scanner->is_overflowed) {
+      scanner->direct_count = count;
+      return;
+    }
+    scanner->is_overflowed = true;
+    scanner->pending.insert(scanner->pending.end(), hits, hits + count);
+  }
+
+  // copy pending hits into the caller's array
+  size_t take_pending(lw_c_scanner_t* scanner,
+                      lw_c_hit_t* hits,
+                      size_t capacity) {
+    const size_t available = scanner->pending.size() - scanner->next;
+    const size_t count = (available < capacity) ? available : capacity;
+    if (count != 0) {
+      std::memcpy(hits, scanner->pending.data() + scanner->next,
+                  count * sizeof(lw_c_hit_t));
+      scanner->next += count;
+    }
+    if (scanner->next == scanner->pending.size()) {
+      scanner->pending.clear();
+      scanner->next = 0;
+    }
+    return count;
+  }
+}
+
+// exceptions must not cross the C interface
+extern "C" {
+
+lw_c_program_t* lw_program_new(void) {
+  return new (std::nothrow) lw_c_program;
+}
+
+void lw_program_free(lw_c_program_t* program) {
+  delete program;
+}
+
+int lw_program_add(lw_c_program_t* program,
+                   const char* regex,
+                   const char* character_encoding,
+                   int is_case_insensitive,
+                   int is_fixed_string) {
+  if (program == nullptr) {
+    return -1;
+  }
+  if (regex == nullptr || character_encoding == nullptr) {
+    program->error = "Usage error: regex and character_encoding are "
+                     "required.";
+    return -1;
+  }
+  if (program->is_finalized) {
+    program->error = "Usage error: regexes may not be added after the "
+                     "program is finalized.";
+    return -1;
+  }
+  try {
+    // hits are delivered in batches so no per-pattern function is needed
+    program->error = program->scanner_program.add_regex(regex,
+                       character_encoding, is_case_insensitive != 0,
+                       is_fixed_string != 0, nullptr);
+  } catch (const std::exception& e) {
+    program->error = e.what();
+  }
+  if (program->error != "") {
+    return -1;
+  }
+  return program->pattern_count++;
+}
+
+int lw_program_finalize(lw_c_program_t* program, int is_determinized) {
+  if (program == nullptr) {
+    return -1;
+  }
+  if (program->is_finalized) {
+    program->error = "Usage error: the program is already finalized.";
+    return -1;
+  }
+  if (program->pattern_count == 0) {
+    program->error = "Usage error: at least one regex must be added.";
+    return -1;
+  }
+  try {
+    program->scanner_program.finalize_program(is_determinized != 0);
+  } catch (const std::exception& e) {
+    program->error = e.what();
+    return -1;
+  }
+  program->is_finalized = true;
+  program->error = "";
+  return 0;
+}
+
+const char* lw_program_error(const lw_c_program_t* program) {
+  return (program == nullptr) ? "" : program->error.c_str();
+}
+
+lw_c_scanner_t* lw_scanner_new(const lw_c_program_t* program) {
+  if (program == nullptr || !program->is_finalized) {
+    return nullptr;
+  }
+  try {
+    lw_c_scanner_t* scanner = new lw_c_scanner(program->scanner_program);
+    scanner->scanner.set_batch_callback(collect_pending, 0);
+    return scanner;
+  } catch (const std::exception&) {
+    return nullptr;
+  }
+}
+
+void lw_scanner_free(lw_c_scanner_t* scanner) {
+  delete scanner;
+}
+
+void lw_scanner_reset(lw_c_scanner_t* scanner) {
+  if (scanner == nullptr) {
+    return;
+  }
+  scanner->scanner.reset(scanner);
+  scanner->pending.clear();
+  scanner->next = 0;
+}
+
+size_t lw_scan_buffer_into(lw_c_scanner_t* scanner,
+                           uint64_t start,
+                           const char* buffer,
+                           size_t size,
+                           int is_final,
+                           lw_c_hit_t* hits,
+                           size_t capacity) {
+  if (scanner == nullptr) {
+    return 0;
+  }
+
+  // write hits straight into the caller's array unless earlier hits are
+  // still waiting to be taken ahead of them
+  const bool is_direct = hits != nullptr && capacity != 0 &&
+                         scanner->next == scanner->pending.size();
+  if (is_direct) {
+    scanner->is_overflowed = false;
+    scanner->direct_count = 0;
+    scanner->scanner.set_batch_callback(collect_direct, capacity,
+                                  reinterpret_cast<lw::lw_hit_t*>(hits));
+  }
+  try {
+    if (buffer != nullptr && size != 0) {
+      scanner->scanner.scan(start, buffer, size);
+    }
+    if (is_final != 0) {
+      scanner->scanner.scan_finalize();
+    }
+  } catch (const std::exception&) {
+    // out of memory, so deliver what was collected
+  }
+  if (is_direct) {
+    // restoring the internal batch delivers the hits left in the array
+    scanner->is_closing = true;
+    scanner->scanner.set_batch_callback(collect_pending, 0);
+    scanner->is_closing = false;
+    if (!scanner->is_overflowed) {
+      return scanner->direct_count;
+    }
+  }
+  return (hits == nullptr) ? 0 : take_pending(scanner, hits, capacity);
+}
+
+size_t lw_scanner_take_hits(lw_c_scanner_t* scanner,
+                            lw_c_hit_t* hits,
+                            size_t capacity) {
+  if (scanner == nullptr || hits == nullptr) {
+    return 0;
+  }
+  return take_pending(scanner, hits, capacity);
+}
+
+size_t lw_scanner_pending_hits(const lw_c_scanner_t* scanner) {
+  return (scanner == nullptr) ? 0 :
+                                scanner->pending.size() - scanner->next;
+}
+
+}
@@ -0,0 +1,190 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <stdint.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  static bool is_same_hit(const LG_SearchHit& a, const LG_SearchHit& b) {
+    return a.Start == b.Start && a.End == b.End &&
+           a.KeywordIndex == b.KeywordIndex;
+  }
+
+  static bool is_inside(const LG_SearchHit& inner,
+                        const LG_SearchHit& outer) {
+    return outer.Start <= inner.Start && inner.End <= outer.End;
+  }
+
+  // true if hit is superseded by an earlier hit
+  static bool is_superseded(const unsigned int mode,
+                            const LG_SearchHit& hit,
+                            const LG_SearchHit& earlier) {
+    return ((mode & LW_FILTER_DUPLICATES) && is_same_hit(hit, earlier)) ||
+           ((mode & LW_FILTER_LONGEST) && hit.Start == earlier.Start &&
+                                          hit.End <= earlier.End) ||
+           ((mode & LW_FILTER_CONTAINED) && is_inside(hit, earlier));
+  }
+
+  // true if a held hit is replaced by a later hit
+  static bool is_replaced(const unsigned int mode,
+                          const LG_SearchHit& held,
+                          const LG_SearchHit& hit) {
+    return ((mode & LW_FILTER_LONGEST) && held.Start == hit.Start &&
+                                          held.End < hit.End) ||
+           ((mode & LW_FILTER_CONTAINED) && is_inside(held, hit));
+  }
+
+  // the first hit in hits, which are ordered by start, that starts at or
+  // after start
+  static std::deque<LG_SearchHit>::iterator first_from(
+                          std::deque<LG_SearchHit>& hits,
+                          const uint64_t start) {
+    return std::lower_bound(hits.begin(), hits.end(), start,
+                         [](const LG_SearchHit& hit, const uint64_t offset) {
+                           return hit.Start < offset; });
+  }
+
+  // add hit to hits, which are ordered by start, after hits with the
+  // same start
+  static void insert_ordered(std::deque<LG_SearchHit>& hits,
+                             const LG_SearchHit& hit) {
+    hits.insert(std::upper_bound(hits.begin(), hits.end(), hit.Start,
+                         [](const uint64_t offset, const LG_SearchHit& other) {
+                           return offset < other.Start; }),
+                hit);
+  }
+
+  // true if a hit in hits supersedes hit.  Only hits that start where hit
+  // starts can supersede it, or when contained hits are dropped, hits
+  // that start no earlier than the longest hit size before its end.
+  static bool is_superseded_by(const unsigned int mode,
+                               const LG_SearchHit& hit,
+                               std::deque<LG_SearchHit>& hits,
+                               const uint64_t longest_hit_size) {
+    const uint64_t first = !(mode & LW_FILTER_CONTAINED) ? hit.Start :
+                           (hit.End > longest_hit_size) ?
+                           hit.End - longest_hit_size : 0;
+    for (auto it = first_from(hits, first);
+              it != hits.end() && it->Start <= hit.Start; ++it) {
+      if (is_superseded(mode, hit, *it)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // constructor
+  hit_filter_t::hit_filter_t() :
+            mode(LW_FILTER_NONE), window_size(0), next_callback(nullptr),
+            next_callback_data(nullptr), pending(), recent(),
+            longest_hit_size(0) {
+  }
+
+  // add
+  void hit_filter_t::add(const LG_SearchHit& hit) {
+    if (hit.End - hit.Start > longest_hit_size) {
+      longest_hit_size = hit.End - hit.Start;
+    }
+
+    // drop the hit if a held or recently reported hit supersedes it
+    if (is_superseded_by(mode, hit, pending, longest_hit_size) ||
+        is_superseded_by(mode, hit, recent, longest_hit_size)) {
+      return;
+    }
+
+    // drop held hits that this hit replaces, which start where it
+    // starts or, when contained hits are dropped, inside it
+    const uint64_t last = (mode & LW_FILTER_CONTAINED) ? hit.End : hit.Start;
+    auto it = first_from(pending, hit.Start);
+    while (it != pending.end() && it->Start <= last) {
+      if (is_replaced(mode, *it, hit)) {
+        it = pending.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    // then hold it
+    insert_ordered(pending, hit);
+  }
+
+  // release hits that start more than window_size bytes before stream_end
+  void hit_filter_t::release(const uint64_t stream_end) {
+
+    // forget reported hits after a further window
+    while (!recent.empty() &&
+           recent.front().Start + 2 * window_size <= stream_end) {
+      recent.pop_front();
+    }
+
+    // report held hits in start order
+    while (!pending.empty() &&
+           pending.front().Start + window_size <= stream_end) {
+      const LG_SearchHit hit = pending.front();
+      pending.pop_front();
+      (*next_callback)(next_callback_data, &hit);
+      insert_ordered(recent, hit);
+    }
+  }
+
+  // release all held hits
+  void hit_filter_t::release_all() {
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+      (*next_callback)(next_callback_data, &*it);
+      insert_ordered(recent, *it);
+    }
+    pending.clear();
+  }
+
+  // forget reported hits, which belong to the stream that ended
+  void hit_filter_t::end_stream() {
+    recent.clear();
+    longest_hit_size = 0;
+  }
+
+  // filter lightgrep callback function, which holds hits for add
+  void lightgrep_filter_callback(void* p_hit_filter, const LG_SearchHit* hit) {
+    static_cast<hit_filter_t*>(p_hit_filter)->add(*hit);
+  }
+
+  // set_hit_filter
+  std::string lw_scanner_t::set_hit_filter(const unsigned int mode,
+                                           const uint64_t window_size) {
+    if ((mode & ~static_cast<unsigned int>(LW_FILTER_DUPLICATES |
+                        LW_FILTER_LONGEST | LW_FILTER_CONTAINED)) != 0) {
+      return "Usage error: invalid hit filter mode.";
+    }
+
+    // report hits held using the previous settings
+    hit_filter.release_all();
+    flush_hits();
+    hit_filter.end_stream();
+
+    hit_filter.mode = mode;
+    hit_filter.window_size = window_size;
+    update_hit_callback();
+    return "";
+  }
+}
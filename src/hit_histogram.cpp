@@ -0,0 +1,153 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <stdint.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // constructor
+  lw_pattern_histogram_t::lw_pattern_histogram_t() :
+            count(0), first_offset(0), last_offset(0), feature_counts() {
+  }
+
+  // constructor
+  lw_hit_histogram_t::lw_hit_histogram_t(const bool p_is_keyed_by_data) :
+            is_keyed_by_data(p_is_keyed_by_data), patterns() {
+  }
+
+  // add
+  void lw_hit_histogram_t::add(const lw_hit_t& hit,
+                               const char* const data,
+                               const size_t size) {
+    if (hit.pattern_index >= patterns.size()) {
+      patterns.resize(hit.pattern_index + 1);
+    }
+    lw_pattern_histogram_t& pattern_histogram = patterns[hit.pattern_index];
+    if (pattern_histogram.count == 0 ||
+        hit.start < pattern_histogram.first_offset) {
+      pattern_histogram.first_offset = hit.start;
+    }
+    if (pattern_histogram.count == 0 ||
+        hit.start > pattern_histogram.last_offset) {
+      pattern_histogram.last_offset = hit.start;
+    }
+    ++pattern_histogram.count;
+    if (is_keyed_by_data && data != nullptr) {
+      ++pattern_histogram.feature_counts[std::string(data, size)];
+    }
+  }
+
+  // batch_callback
+  void lw_hit_histogram_t::batch_callback(const lw_hit_t* hits,
+                                          const size_t count,
+                                          void* p_histogram) {
+    lw_hit_histogram_t* histogram(
+                         static_cast<lw_hit_histogram_t*>(p_histogram));
+    for (size_t i = 0; i < count; ++i) {
+      histogram->add(hits[i], nullptr, 0);
+    }
+  }
+
+  // record_callback
+  void lw_hit_histogram_t::record_callback(const lw_hit_record_t* records,
+                                           const size_t count,
+                                           void* p_histogram) {
+    lw_hit_histogram_t* histogram(
+                         static_cast<lw_hit_histogram_t*>(p_histogram));
+    for (size_t i = 0; i < count; ++i) {
+
+      // the match data within the record's context, if available
+      const lw_hit_record_t& record = records[i];
+      const uint64_t match_offset = record.hit.start - record.data_offset;
+      if (record.hit.start >= record.data_offset &&
+          match_offset + record.hit.size <= record.data_size) {
+        histogram->add(record.hit, record.data + match_offset,
+                       record.hit.size);
+      } else {
+        histogram->add(record.hit, nullptr, 0);
+      }
+    }
+  }
+
+  // merge
+  void lw_hit_histogram_t::merge(const lw_hit_histogram_t& other) {
+    if (patterns.size() < other.patterns.size()) {
+      patterns.resize(other.patterns.size());
+    }
+    for (size_t i = 0; i < other.patterns.size(); ++i) {
+      const lw_pattern_histogram_t& from = other.patterns[i];
+      lw_pattern_histogram_t& to = patterns[i];
+      if (from.count == 0) {
+        continue;
+      }
+      if (to.count == 0 || from.first_offset < to.first_offset) {
+        to.first_offset = from.first_offset;
+      }
+      if (to.count == 0 || from.last_offset > to.last_offset) {
+        to.last_offset = from.last_offset;
+      }
+      to.count += from.count;
+      for (auto it = from.feature_counts.begin();
+           it != from.feature_counts.end(); ++it) {
+        to.feature_counts[it->first] += it->second;
+      }
+    }
+  }
+
+  // pattern_count
+  size_t lw_hit_histogram_t::pattern_count() const {
+    return patterns.size();
+  }
+
+  // pattern
+  const lw_pattern_histogram_t& lw_hit_histogram_t::pattern(
+                                      const size_t pattern_index) const {
+    return patterns.at(pattern_index);
+  }
+
+  // top_features
+  std::vector<std::pair<std::string, uint64_t> >
+          lw_hit_histogram_t::top_features(const size_t pattern_index,
+                                           const size_t k) const {
+
+    typedef std::pair<std::string, uint64_t> feature_t;
+    std::vector<feature_t> features;
+    if (pattern_index >= patterns.size()) {
+      return features;
+    }
+    const std::unordered_map<std::string, uint64_t>& feature_counts =
+                                     patterns[pattern_index].feature_counts;
+    features.assign(feature_counts.begin(), feature_counts.end());
+    const size_t top = (k < features.size()) ? k : features.size();
+    std::partial_sort(features.begin(), features.begin() + top,
+                      features.end(),
+                      [](const feature_t& a, const feature_t& b) {
+                        return (a.second != b.second) ? a.second > b.second :
+                                                        a.first < b.first; });
+    features.resize(top);
+    return features;
+  }
+}
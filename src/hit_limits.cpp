@@ -0,0 +1,93 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // constructor
+  hit_limits_t::hit_limits_t() :
+            max_total_hits(0), max_pattern_hits(0), total_hits(0),
+            pattern_hits(), capped_pattern_count(0), is_stopped(false),
+            is_stream_ended(false), next_callback(nullptr),
+            next_callback_data(nullptr) {
+  }
+
+  // is_enabled
+  bool hit_limits_t::is_enabled() const {
+    return max_total_hits != 0 || max_pattern_hits != 0;
+  }
+
+  // clear
+  void hit_limits_t::clear() {
+    total_hits = 0;
+    std::fill(pattern_hits.begin(), pattern_hits.end(), 0);
+    capped_pattern_count = 0;
+    is_stopped = false;
+    is_stream_ended = false;
+  }
+
+  // pass hits on until a limit is reached
+  void lightgrep_limits_callback(void* p_hit_limits, const LG_SearchHit* hit) {
+    hit_limits_t* hit_limits = static_cast<hit_limits_t*>(p_hit_limits);
+    if (hit_limits->is_stopped) {
+      return;
+    }
+
+    // drop hits for patterns at their limit
+    if (hit_limits->max_pattern_hits != 0) {
+      uint64_t& count = hit_limits->pattern_hits[hit->KeywordIndex];
+      if (count == hit_limits->max_pattern_hits) {
+        return;
+      }
+      ++count;
+      if (count == hit_limits->max_pattern_hits) {
+        ++hit_limits->capped_pattern_count;
+        if (hit_limits->capped_pattern_count ==
+                                      hit_limits->pattern_hits.size()) {
+          hit_limits->is_stopped = true;
+        }
+      }
+    }
+
+    ++hit_limits->total_hits;
+    if (hit_limits->total_hits == hit_limits->max_total_hits) {
+      hit_limits->is_stopped = true;
+    }
+    hit_limits->next_callback(hit_limits->next_callback_data, hit);
+  }
+
+  // set_hit_limits
+  void lw_scanner_t::set_hit_limits(const uint64_t max_total_hits,
+                                    const uint64_t max_pattern_hits) {
+    hit_limits.max_total_hits = max_total_hits;
+    hit_limits.max_pattern_hits = max_pattern_hits;
+    hit_limits.clear();
+    update_hit_callback();
+  }
+
+  // is_stopped
+  bool lw_scanner_t::is_stopped() const {
+    return hit_limits.is_stopped;
+  }
+}
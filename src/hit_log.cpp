@@ -0,0 +1,313 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+// Hit log file layout, in native byte order:
+//   char[8]  magic
+//   then for each hit:
+//     hit_log_record_t
+//     data bytes, data_size of them
+
+#include <config.h>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  static const char hit_log_magic[8] = {'L','W','H','I','T','S','0','1'};
+
+  struct hit_log_record_t {
+    uint64_t start;
+    uint64_t size;
+    uint64_t data_offset;
+    uint32_t pattern_index;
+    uint32_t logical_index;
+    uint32_t data_size;
+    uint32_t reserved;
+  };
+
+  static std::string compose_log_error(const std::string& action,
+                                       const std::string& filename) {
+    std::stringstream ss;
+    ss << action << " hit log";
+    if (filename != "") {
+      ss << " '" << filename << "'";
+    }
+    if (errno != 0) {
+      ss << ": " << std::strerror(errno);
+    }
+    return ss.str();
+  }
+
+  // write all of data, returning errno or 0
+  static int write_fully(const int fd, const char* data, size_t size) {
+    while (size != 0) {
+      const ssize_t count = ::write(fd, data, size);
+      if (count < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return errno;
+      }
+      data += count;
+      size -= static_cast<size_t>(count);
+    }
+    return 0;
+  }
+
+  // constructor
+  lw_hit_log_writer_t::lw_hit_log_writer_t() :
+             fd(-1), buffer_size(0), active_buffer(), write_buffer(),
+             writer_thread(), mutex(), condition(), is_writing(false),
+             is_stopping(false), write_error() {
+  }
+
+  // destructor
+  lw_hit_log_writer_t::~lw_hit_log_writer_t() {
+    close();
+  }
+
+  // open
+  std::string lw_hit_log_writer_t::open(const std::string& filename,
+                                        const size_t p_buffer_size) {
+    if (fd >= 0) {
+      return "Usage error: the hit log is already open.";
+    }
+    errno = 0;
+    fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+      return compose_log_error("Unable to create", filename);
+    }
+    buffer_size = (p_buffer_size < sizeof(hit_log_record_t)) ?
+                             sizeof(hit_log_record_t) : p_buffer_size;
+    active_buffer.reserve(buffer_size);
+    write_buffer.reserve(buffer_size);
+    active_buffer.assign(hit_log_magic, hit_log_magic + sizeof(hit_log_magic));
+    is_writing = false;
+    is_stopping = false;
+    write_error = "";
+    writer_thread = std::thread(&lw_hit_log_writer_t::write_loop, this);
+    return "";
+  }
+
+  // write_loop
+  void lw_hit_log_writer_t::write_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      condition.wait(lock, [this] { return is_writing || is_stopping; });
+      if (!is_writing) {
+        return;
+      }
+
+      // write without holding the lock so the scanner can keep filling
+      // the active buffer
+      lock.unlock();
+      const int error_number = write_fully(fd, write_buffer.data(),
+                                           write_buffer.size());
+      lock.lock();
+      if (error_number != 0 && write_error == "") {
+        errno = error_number;
+        write_error = compose_log_error("Unable to write", "");
+      }
+      write_buffer.clear();
+      is_writing = false;
+      condition.notify_all();
+    }
+  }
+
+  // submit
+  void lw_hit_log_writer_t::submit() {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return !is_writing; });
+    active_buffer.swap(write_buffer);
+    is_writing = true;
+    condition.notify_all();
+    lock.unlock();
+    active_buffer.clear();
+  }
+
+  // append
+  void lw_hit_log_writer_t::append(const lw_hit_t& hit,
+                                   const uint64_t data_offset,
+                                   const char* const data,
+                                   const size_t data_size) {
+    if (fd < 0) {
+      return;
+    }
+    const size_t record_size = sizeof(hit_log_record_t) + data_size;
+    if (active_buffer.size() + record_size > buffer_size &&
+        !active_buffer.empty()) {
+      submit();
+    }
+
+    hit_log_record_t header;
+    header.start = hit.start;
+    header.size = hit.size;
+    header.data_offset = data_offset;
+    header.pattern_index = hit.pattern_index;
+    header.logical_index = hit.logical_index;
+    header.data_size = static_cast<uint32_t>(data_size);
+    header.reserved = 0;
+    const char* const p = reinterpret_cast<const char*>(&header);
+    active_buffer.insert(active_buffer.end(), p, p + sizeof(header));
+    if (data_size != 0) {
+      active_buffer.insert(active_buffer.end(), data, data + data_size);
+    }
+  }
+
+  // write
+  void lw_hit_log_writer_t::write(const lw_hit_t& hit) {
+    append(hit, hit.start, nullptr, 0);
+  }
+
+  // write
+  void lw_hit_log_writer_t::write(const lw_hit_record_t& record) {
+    append(record.hit, record.data_offset, record.data, record.data_size);
+  }
+
+  // batch_callback
+  void lw_hit_log_writer_t::batch_callback(const lw_hit_t* hits,
+                                           const size_t count,
+                                           void* p_writer) {
+    lw_hit_log_writer_t* writer(static_cast<lw_hit_log_writer_t*>(p_writer));
+    for (size_t i = 0; i < count; ++i) {
+      writer->write(hits[i]);
+    }
+  }
+
+  // record_callback
+  void lw_hit_log_writer_t::record_callback(const lw_hit_record_t* records,
+                                            const size_t count,
+                                            void* p_writer) {
+    lw_hit_log_writer_t* writer(static_cast<lw_hit_log_writer_t*>(p_writer));
+    for (size_t i = 0; i < count; ++i) {
+      writer->write(records[i]);
+    }
+  }
+
+  // close
+  std::string lw_hit_log_writer_t::close() {
+    if (fd < 0) {
+      return "";
+    }
+
+    // write the rest and stop the background writer
+    if (!active_buffer.empty()) {
+      submit();
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      is_stopping = true;
+      condition.notify_all();
+    }
+    writer_thread.join();
+
+    errno = 0;
+    std::string error = write_error;
+    if (::close(fd) != 0 && error == "") {
+      error = compose_log_error("Unable to close", "");
+    }
+    fd = -1;
+    return error;
+  }
+
+  // constructor
+  lw_hit_log_reader_t::lw_hit_log_reader_t() :
+             map(nullptr), map_size(0), position(0) {
+  }
+
+  // destructor
+  lw_hit_log_reader_t::~lw_hit_log_reader_t() {
+    close();
+  }
+
+  // open
+  std::string lw_hit_log_reader_t::open(const std::string& filename) {
+    close();
+    errno = 0;
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return compose_log_error("Unable to open", filename);
+    }
+    const off_t end = ::lseek(fd, 0, SEEK_END);
+    if (end < static_cast<off_t>(sizeof(hit_log_magic))) {
+      ::close(fd);
+      errno = 0;
+      return compose_log_error("Invalid", filename);
+    }
+    void* const p = ::mmap(nullptr, static_cast<size_t>(end), PROT_READ,
+                           MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      return compose_log_error("Unable to map", filename);
+    }
+    ::madvise(p, static_cast<size_t>(end), MADV_SEQUENTIAL);
+    map = static_cast<const char*>(p);
+    map_size = static_cast<size_t>(end);
+    if (std::memcmp(map, hit_log_magic, sizeof(hit_log_magic)) != 0) {
+      close();
+      errno = 0;
+      return compose_log_error("Invalid", filename);
+    }
+    position = sizeof(hit_log_magic);
+    return "";
+  }
+
+  // next
+  bool lw_hit_log_reader_t::next(lw_hit_record_t& record) {
+    if (map == nullptr ||
+        map_size - position < sizeof(hit_log_record_t)) {
+      return false;
+    }
+    hit_log_record_t header;
+    std::memcpy(&header, map + position, sizeof(header));
+    if (map_size - position - sizeof(header) < header.data_size) {
+      return false;
+    }
+    record.hit.start = header.start;
+    record.hit.size = header.size;
+    record.hit.pattern_index = header.pattern_index;
+    record.hit.logical_index = header.logical_index;
+    record.data_offset = header.data_offset;
+    record.data = map + position + sizeof(header);
+    record.data_size = header.data_size;
+    position += sizeof(header) + header.data_size;
+    return true;
+  }
+
+  // close
+  void lw_hit_log_reader_t::close() {
+    if (map != nullptr) {
+      ::munmap(const_cast<char*>(map), map_size);
+      map = nullptr;
+      map_size = 0;
+      position = 0;
+    }
+  }
+}
@@ -0,0 +1,202 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <lightgrep/api.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // the size of the first arena block
+  static const size_t arena_block_size = 1 << 16;
+
+  // constructor
+  hit_arena_t::hit_arena_t() : blocks(), current(0), used(0) {
+  }
+
+  // allocate
+  char* hit_arena_t::allocate(const size_t size) {
+
+    // bump the pointer in the current block or a later one
+    while (current < blocks.size()) {
+      if (used + size <= blocks[current].size()) {
+        char* const p = blocks[current].data() + used;
+        used += size;
+        return p;
+      }
+      ++current;
+      used = 0;
+    }
+
+    // add a block, at least twice the size of the last one
+    const size_t last_size = blocks.empty() ? arena_block_size / 2 :
+                                              blocks.back().size();
+    const size_t block_size = (size > 2 * last_size) ? size : 2 * last_size;
+    blocks.push_back(std::vector<char>(block_size));
+    current = blocks.size() - 1;
+    used = size;
+    return blocks[current].data();
+  }
+
+  // reset
+  void hit_arena_t::reset() {
+
+    // replace several blocks with one that fits them all, so that later
+    // batches of the same size use one block
+    if (blocks.size() > 1) {
+      size_t total = 0;
+      for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        total += it->size();
+      }
+      blocks.clear();
+      blocks.push_back(std::vector<char>(total));
+    }
+    current = 0;
+    used = 0;
+  }
+
+  // constructor
+  hit_records_t::hit_records_t() :
+            record_callback(nullptr), user_data(nullptr),
+            logical_indices(nullptr), left_context_size(0),
+            right_context_size(0), batch_size(0), records(), arena(),
+            previous_offset(0), previous_buffer(nullptr), previous_size(0),
+            buffer_offset(0), buffer(nullptr), buffer_size(0) {
+  }
+
+  // set_buffer
+  void hit_records_t::set_buffer(const uint64_t offset,
+                                 const char* const p_buffer,
+                                 const size_t size) {
+
+    // keep the current buffer if it is adjacent to the new one, unless
+    // the new data was read into the same memory
+    if (buffer != nullptr && buffer_offset + buffer_size == offset &&
+        (p_buffer >= buffer + buffer_size || p_buffer + size <= buffer)) {
+      previous_offset = buffer_offset;
+      previous_buffer = buffer;
+      previous_size = buffer_size;
+    } else {
+      previous_offset = offset;
+      previous_buffer = nullptr;
+      previous_size = 0;
+    }
+    buffer_offset = offset;
+    buffer = p_buffer;
+    buffer_size = size;
+  }
+
+  // clear_buffers
+  void hit_records_t::clear_buffers() {
+    previous_buffer = nullptr;
+    previous_size = 0;
+    buffer = nullptr;
+    buffer_size = 0;
+  }
+
+  // flush
+  void hit_records_t::flush() {
+    if (!records.empty()) {
+      (*record_callback)(records.data(), records.size(), user_data);
+      records.clear();
+    }
+    arena.reset();
+  }
+
+  // record lightgrep callback function
+  void lightgrep_record_callback(void* p_hit_records,
+                                 const LG_SearchHit* hit) {
+
+    // get hit records
+    hit_records_t* hit_records(static_cast<hit_records_t*>(p_hit_records));
+
+    // locate the match and its context in the buffers
+    const uint64_t left = (hit->Start < hit_records->left_context_size) ?
+                          hit->Start : hit_records->left_context_size;
+    const uint64_t size = hit->End - hit->Start;
+    const buffer_view_t view = (hit_records->buffer == nullptr) ?
+                  buffer_view_t{{nullptr, 0}, {nullptr, 0}} :
+                  read_buffer_view(hit_records->buffer_offset,
+                                   hit_records->previous_buffer,
+                                   hit_records->previous_size,
+                                   hit_records->buffer,
+                                   hit_records->buffer_size,
+                                   hit->Start - left,
+                                   left + size +
+                                       hit_records->right_context_size,
+                                   0);
+
+    // copy them into the arena
+    char* const data = hit_records->arena.allocate(view.size());
+    if (view.first.size != 0) {
+      std::memcpy(data, view.first.data, view.first.size);
+    }
+    if (view.second.size != 0) {
+      std::memcpy(data + view.first.size, view.second.data,
+                  view.second.size);
+    }
+
+    // record the hit
+    lw_hit_record_t record;
+    record.hit.start = hit->Start;
+    record.hit.size = size;
+    record.hit.pattern_index = hit->KeywordIndex;
+    record.hit.logical_index =
+                     (*hit_records->logical_indices)[hit->KeywordIndex];
+    record.data_offset = (view.first.size != 0) ?
+          hit_records->previous_offset +
+                       (view.first.data - hit_records->previous_buffer) :
+          (view.second.size != 0) ?
+          hit_records->buffer_offset +
+                       (view.second.data - hit_records->buffer) :
+          hit->Start;
+    record.data = data;
+    record.data_size = view.size();
+    hit_records->records.push_back(record);
+
+    // deliver the batch when it is full
+    if (hit_records->records.size() == hit_records->batch_size) {
+      hit_records->flush();
+    }
+  }
+
+  // set_record_callback
+  void lw_scanner_t::set_record_callback(
+                         record_callback_function_t record_callback,
+                         const size_t left_context_size,
+                         const size_t right_context_size,
+                         const size_t batch_size) {
+
+    // deliver any hits collected using the previous settings
+    flush_hits();
+
+    hit_records.record_callback = record_callback;
+    hit_records.left_context_size = left_context_size;
+    hit_records.right_context_size = right_context_size;
+    hit_records.batch_size = batch_size;
+    if (batch_size != 0) {
+      hit_records.records.reserve(batch_size);
+    }
+    update_hit_callback();
+  }
+}
@@ -25,6 +25,7 @@
 #include <cstring>
 #include <iostream>
 #include <cassert>
+#include <chrono>
 #include <lightgrep/api.h>
 #include "lightgrep_wrapper.hpp"
 
@@ -38,6 +39,9 @@ const char* lightgrep_wrapper_version() {
 
 namespace lw {
 
+  // while hit limits are set, scan searches in slices of this size
+  static const size_t limited_slice_size = 1 << 16;
+
   // parse error
   std::string compose_error(const std::string& regex, const LG_Error& error) {
     std::stringstream ss;
@@ -74,8 +78,8 @@ namespace lw {
     data_pair_t* data_pair(static_cast<data_pair_t*>(p_data_pair));
 
     // get the stage 2 user-provided scan callback function
-    scan_callback_function_t f = data_pair->function_pointers->at(
-                                                     hit->KeywordIndex);
+    scan_callback_function_t f =
+                        (*data_pair->function_pointers)[hit->KeywordIndex];
 
     // call out to the stage 2 user-provided scan callback function
     (*f)(hit->Start,
@@ -83,6 +87,77 @@ namespace lw {
          data_pair->user_data);
   }
 
+  // batch mode lightgrep callback function
+  void lightgrep_batch_callback(void* p_hit_batch, const LG_SearchHit* hit) {
+
+    // get hit batch
+    hit_batch_t* hit_batch(static_cast<hit_batch_t*>(p_hit_batch));
+
+    // grow internal storage as needed when batches are unbounded
+    if (hit_batch->count == hit_batch->capacity) {
+      hit_batch->storage.resize(hit_batch->storage.size() * 2 + 64);
+      hit_batch->hits = hit_batch->storage.data();
+      hit_batch->capacity = hit_batch->storage.size();
+    }
+
+    // record the hit
+    lw_hit_t& lw_hit = hit_batch->hits[hit_batch->count++];
+    lw_hit.start = hit->Start;
+    lw_hit.size = hit->End - hit->Start;
+    lw_hit.pattern_index = hit->KeywordIndex;
+    lw_hit.logical_index = (*hit_batch->logical_indices)[hit->KeywordIndex];
+
+    // deliver the batch when it is full
+    if (hit_batch->count == hit_batch->batch_size) {
+      hit_batch->flush();
+    }
+  }
+
+  // statistics lightgrep callback function, which passes hits on
+  void lightgrep_stats_callback(void* p_hit_stats, const LG_SearchHit* hit) {
+
+    // get hit stats
+    hit_stats_t* hit_stats(static_cast<hit_stats_t*>(p_hit_stats));
+
+    // count the hit
+    ++hit_stats->stats.hit_counts[hit->KeywordIndex];
+
+    // pass the hit on
+    if (hit_stats->is_callback_timed) {
+      const auto start = std::chrono::steady_clock::now();
+      (*hit_stats->next_callback)(hit_stats->next_callback_data, hit);
+      hit_stats->stats.callback_nanoseconds +=
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - start).count();
+    } else {
+      (*hit_stats->next_callback)(hit_stats->next_callback_data, hit);
+    }
+  }
+
+  // times lightgrep searches and callbacks when statistics are enabled
+  class stats_timer_t {
+    private:
+    uint64_t* const nanoseconds;
+    const std::chrono::steady_clock::time_point start;
+
+    // do not allow copy or assignment
+    stats_timer_t(const stats_timer_t&) = delete;
+    stats_timer_t& operator=(const stats_timer_t&) = delete;
+
+    public:
+    stats_timer_t(const hit_stats_t& hit_stats, uint64_t* p_nanoseconds) :
+             nanoseconds(hit_stats.is_enabled ? p_nanoseconds : nullptr),
+             start(hit_stats.is_enabled ? std::chrono::steady_clock::now() :
+                                      std::chrono::steady_clock::time_point()) {
+    }
+    ~stats_timer_t() {
+      if (nanoseconds != nullptr) {
+        *nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+      }
+    }
+  };
+
   // constructor
   data_pair_t::data_pair_t(const function_pointers_t* p_function_pointers,
                            void* p_user_data) :
@@ -105,7 +180,22 @@ namespace lw {
          program(nullptr),
 
          // the list of scan callback function pointers
-         function_pointers()
+         function_pointers(),
+
+         // the logical index and encoding of each pattern
+         logical_indices(),
+         pattern_encodings(),
+
+         // the scan callback function pointer of each pattern, once finalized
+         pattern_function_pointers(),
+
+         // FNV-1a offset basis
+         pattern_set_hash(14695981039346656037ULL),
+
+         // the prefilter is kept while every pattern is a literal
+         prefilter_bytes(256, 0),
+         prefilter_max_size(0),
+         is_prefilterable(true)
   {
   }
 
@@ -120,12 +210,11 @@ namespace lw {
     lg_destroy_program(program);
   }
 
-  // add_regex
-  std::string lw_scanner_program_t::add_regex(const std::string& regex,
-                              const std::string& character_encoding,
-                              const bool is_case_insensitive,
-                              const bool is_fixed_string,
-                              const scan_callback_function_t f) {
+  // parse_regex
+  std::string parse_regex(LG_HPATTERN pattern_handle,
+                          const std::string& regex,
+                          const bool is_case_insensitive,
+                          const bool is_fixed_string) {
 
     // configure LG_KeyOptions from regex_settings_t
     LG_KeyOptions key_options;
@@ -149,10 +238,27 @@ namespace lw {
       return parse_error;
     }
 
+    // no error
+    return "";
+  }
+
+  // add_parsed_regex
+  std::string lw_scanner_program_t::add_parsed_regex(
+                              LG_HPATTERN parsed_pattern_handle,
+                              const std::string& regex,
+                              const std::string& character_encoding,
+                              const bool is_case_insensitive,
+                              const bool is_fixed_string,
+                              const scan_callback_function_t f,
+                              const uint32_t logical_index) {
+
+    // potential error
+    LG_Error* error;
+
     // add the pattern
     int index = lg_add_pattern(fsm,
                                pattern_map,
-                               pattern_handle,
+                               parsed_pattern_handle,
                                character_encoding.c_str(),
                                &error);
 
@@ -164,18 +270,101 @@ namespace lw {
       return pattern_error;
     }
 
-    // make sure index is in step with the function_pointers vector
-    if (function_pointers.size() != (size_t)index) {
+    // make sure index is in step with the logical_indices vector
+    if (logical_indices.size() != (size_t)index) {
       assert(0);
     }
 
-    // record the scan callback function pointer at the pattern index position
-    function_pointers.push_back(f);
+    // record the scan callback function pointer once per logical pattern
+    if (function_pointers.size() == logical_index) {
+      function_pointers.push_back(f);
+    }
+    logical_indices.push_back(logical_index);
+    pattern_encodings.push_back(character_encoding);
+
+    // include the regex in the prefilter
+    update_prefilter(regex, character_encoding, is_case_insensitive,
+                     is_fixed_string);
+
+    // include the regex in the hash that keys saved programs
+    pattern_set_hash = hash_regex(pattern_set_hash, regex,
+                                  character_encoding, is_case_insensitive,
+                                  is_fixed_string);
 
     // no error
     return "";
   }
 
+  // add_regex
+  std::string lw_scanner_program_t::add_regex(const std::string& regex,
+                              const std::string& character_encoding,
+                              const bool is_case_insensitive,
+                              const bool is_fixed_string,
+                              const scan_callback_function_t f) {
+
+    // parse regex into pattern
+    const std::string parse_error = parse_regex(pattern_handle, regex,
+                                      is_case_insensitive, is_fixed_string);
+    if (parse_error != "") {
+      return parse_error;
+    }
+
+    // add the pattern
+    return add_parsed_regex(pattern_handle, regex, character_encoding,
+                            is_case_insensitive, is_fixed_string, f,
+                            static_cast<uint32_t>(logical_pattern_count()));
+  }
+
+  // add_regex for several encodings
+  std::string lw_scanner_program_t::add_regex(const std::string& regex,
+                   const std::vector<std::string>& character_encodings,
+                   const bool is_case_insensitive,
+                   const bool is_fixed_string,
+                   const scan_callback_function_t f) {
+
+    if (character_encodings.empty()) {
+      return "Usage error: at least one character encoding is required.";
+    }
+
+    // parse regex into pattern once for all encodings
+    const std::string parse_error = parse_regex(pattern_handle, regex,
+                                      is_case_insensitive, is_fixed_string);
+    if (parse_error != "") {
+      return parse_error;
+    }
+
+    // add the pattern for each encoding under one logical index
+    const uint32_t logical_index =
+                          static_cast<uint32_t>(logical_pattern_count());
+    std::stringstream errors;
+    for (auto it = character_encodings.begin();
+         it != character_encodings.end(); ++it) {
+      const std::string error = add_parsed_regex(pattern_handle, regex, *it,
+                  is_case_insensitive, is_fixed_string, f, logical_index);
+      if (error != "") {
+        errors << error << "\n";
+      }
+    }
+    return errors.str();
+  }
+
+  // logical_pattern_count
+  size_t lw_scanner_program_t::logical_pattern_count() const {
+    return logical_indices.empty() ? 0 : logical_indices.back() + 1;
+  }
+
+  // logical_pattern_index
+  uint32_t lw_scanner_program_t::logical_pattern_index(
+                                      const size_t pattern_index) const {
+    return logical_indices.at(pattern_index);
+  }
+
+  // pattern_encoding
+  const std::string& lw_scanner_program_t::pattern_encoding(
+                                      const size_t pattern_index) const {
+    return pattern_encodings.at(pattern_index);
+  }
+
   // finalize_regex
   void lw_scanner_program_t::finalize_program(bool is_determinized) {
 
@@ -188,9 +377,40 @@ namespace lw {
     program_options.Determinize = is_determinized;
     program = lg_create_program(fsm, &program_options);
 
+    // include the program options in the hash that keys saved programs
+    pattern_set_hash = hash_regex(pattern_set_hash, "", "",
+                                  is_determinized, false);
+
     // discard the FSM now that we have a program
     lg_destroy_fsm(fsm);
     fsm = nullptr;
+
+    finish_prefilter();
+    finish_function_pointers();
+  }
+
+  // finish_function_pointers
+  void lw_scanner_program_t::finish_function_pointers() {
+    pattern_function_pointers.clear();
+    for (auto it = logical_indices.begin(); it != logical_indices.end();
+         ++it) {
+      pattern_function_pointers.push_back(function_pointers[*it]);
+    }
+  }
+
+  // constructor
+  hit_batch_t::hit_batch_t() :
+            batch_callback(nullptr), user_data(nullptr),
+            logical_indices(nullptr), storage(),
+            hits(nullptr), capacity(0), batch_size(0), count(0) {
+  }
+
+  // deliver collected hits
+  void hit_batch_t::flush() {
+    if (count != 0) {
+      (*batch_callback)(hits, count, user_data);
+      count = 0;
+    }
   }
 
   // lw_scanner_t constructor
@@ -199,14 +419,67 @@ namespace lw {
              context_options(create_context_options()),
              searcher(create_searcher(scanner_program.program,
                                       context_options)),
-             data_pair(&(scanner_program.function_pointers), user_data),
+             data_pair(&(scanner_program.pattern_function_pointers),
+                       user_data),
+             hit_batch(),
+             hit_stats(),
+             hit_filter(),
+             hit_records(),
+             hit_limits(),
+             prefilter_bytes(scanner_program.is_prefiltered() ?
+                             scanner_program.prefilter_bytes.data() : nullptr),
+             prefilter_max_size(scanner_program.prefilter_max_size),
+             prefilter_live_end(0),
+             is_search_active(false),
+             skip_run_size(0),
+             skip_fence_size(0),
+             hit_callback(lightgrep_callback),
+             hit_callback_data(&data_pair),
+             file_data(nullptr),
+             file_data_offset(0),
+             file_data_size(0),
              program_is_finalized(searcher != nullptr) {
+    hit_batch.user_data = user_data;
+    hit_batch.logical_indices = &scanner_program.logical_indices;
+    hit_records.user_data = user_data;
+    hit_records.logical_indices = &scanner_program.logical_indices;
+    hit_limits.pattern_hits.resize(scanner_program.logical_indices.size());
+    hit_stats.stats.hit_counts.resize(
+                              scanner_program.logical_indices.size());
   }
 
   lw_scanner_t::~lw_scanner_t() {
     lg_destroy_context(searcher);
   }
 
+  // search
+  void lw_scanner_t::search(const uint64_t stream_offset,
+                            const char* const buffer,
+                            const size_t size) {
+    if (prefilter_bytes != nullptr) {
+      search_prefiltered(stream_offset, buffer, size);
+    } else {
+      lg_search(searcher,
+                buffer,
+                buffer + size,
+                stream_offset,
+                hit_callback_data,
+                hit_callback);
+      is_search_active = true;
+    }
+  }
+
+  // search_buffer
+  void lw_scanner_t::search_buffer(const uint64_t stream_offset,
+                                   const char* const buffer,
+                                   const size_t size) {
+    if (skip_run_size != 0) {
+      search_skipping_runs(stream_offset, buffer, size);
+    } else {
+      search(stream_offset, buffer, size);
+    }
+  }
+
   // scan
   void lw_scanner_t::scan(uint64_t stream_offset,
                           const char* const buffer, size_t size) {
@@ -216,23 +489,63 @@ namespace lw {
       return;
     }
 
-    // scan
-    lg_search(searcher,
-              buffer,
-              buffer + size,
-              stream_offset,
-              &data_pair,
-              lightgrep_callback);
+    // start counting hits for a new stream
+    if (hit_limits.is_stream_ended) {
+      hit_limits.clear();
+    }
+    if (hit_limits.is_stopped) {
+      return;
+    }
+
+    // scan, reading hit context from all of the file data during
+    // scan_file and scan_fd
+    if (file_data != nullptr) {
+      hit_records.clear_buffers();
+      hit_records.set_buffer(file_data_offset, file_data, file_data_size);
+    } else {
+      hit_records.set_buffer(stream_offset, buffer, size);
+    }
+    {
+      stats_timer_t timer(hit_stats, &hit_stats.stats.search_nanoseconds);
+      if (hit_limits.is_enabled()) {
+        // search in slices so that scanning can stop early
+        for (size_t done = 0; done < size && !hit_limits.is_stopped;
+             done += limited_slice_size) {
+          const size_t slice = (size - done < limited_slice_size) ?
+                                       size - done : limited_slice_size;
+          search_buffer(stream_offset + done, buffer + done, slice);
+        }
+      } else {
+        search_buffer(stream_offset, buffer, size);
+      }
+    }
+    if (hit_stats.is_enabled) {
+      hit_stats.stats.bytes_scanned += size;
+    }
+    if (hit_filter.mode != LW_FILTER_NONE) {
+      hit_filter.release(stream_offset + size);
+    }
+    flush_hits();
   }
 
   // scan_finalize
   void lw_scanner_t::scan_finalize() {
 
     // finish scan
-    lg_closeout_search(searcher,
-                       &data_pair,
-                       lightgrep_callback);
+    {
+      stats_timer_t timer(hit_stats, &hit_stats.stats.search_nanoseconds);
+      lg_closeout_search(searcher,
+                         hit_callback_data,
+                         hit_callback);
+    }
     lg_reset_context(searcher);
+    prefilter_live_end = 0;
+    is_search_active = false;
+    hit_filter.release_all();
+    hit_filter.end_stream();
+    flush_hits();
+    hit_records.clear_buffers();
+    hit_limits.is_stream_ended = true;
   }
 
   // scan_fence_finalize
@@ -242,24 +555,153 @@ namespace lw {
 
     // lg doesn't like empty buffer
     if (size == 0) {
-      lg_closeout_search(searcher,
-                         &data_pair,
-                         lightgrep_callback);
-      lg_reset_context(searcher);
+      scan_finalize();
       return;
     }
 
-    // finish scan
-    lg_search_resolve(searcher,
-                      buffer,
-                      buffer + size,
-                      stream_offset,
-                      &data_pair,
-                      lightgrep_callback);
-    lg_closeout_search(searcher,
-                       &data_pair,
-                       lightgrep_callback);
+    // finish scan, unless the hit limits stopped it
+    if (!hit_limits.is_stopped) {
+      hit_records.set_buffer(stream_offset, buffer, size);
+      {
+        stats_timer_t timer(hit_stats, &hit_stats.stats.search_nanoseconds);
+        lg_search_resolve(searcher,
+                          buffer,
+                          buffer + size,
+                          stream_offset,
+                          hit_callback_data,
+                          hit_callback);
+        lg_closeout_search(searcher,
+                           hit_callback_data,
+                           hit_callback);
+      }
+      if (hit_stats.is_enabled) {
+        hit_stats.stats.bytes_scanned += size;
+      }
+    }
     lg_reset_context(searcher);
+    prefilter_live_end = 0;
+    is_search_active = false;
+    hit_filter.release_all();
+    hit_filter.end_stream();
+    flush_hits();
+    hit_records.clear_buffers();
+    hit_limits.is_stream_ended = true;
+  }
+
+  // reset
+  void lw_scanner_t::reset(void* user_data) {
+    if (searcher != nullptr) {
+      lg_reset_context(searcher);
+    }
+    prefilter_live_end = 0;
+    is_search_active = false;
+    hit_batch.count = 0;
+    hit_limits.clear();
+    hit_records.records.clear();
+    hit_records.arena.reset();
+    hit_records.clear_buffers();
+    hit_filter.pending.clear();
+    hit_filter.end_stream();
+    data_pair.user_data = user_data;
+    hit_batch.user_data = user_data;
+    hit_records.user_data = user_data;
+  }
+
+  // set_batch_callback
+  std::string lw_scanner_t::set_batch_callback(
+                         batch_callback_function_t batch_callback,
+                         const size_t batch_size,
+                         lw_hit_t* const hits) {
+
+    if (hits != nullptr && batch_size == 0) {
+      return "Usage error: batch_size must be the capacity of hits.";
+    }
+
+    // deliver any hits collected using the previous settings
+    flush_hits();
+
+    // restore per-pattern callbacks
+    if (batch_callback == nullptr) {
+      hit_batch.batch_callback = nullptr;
+      update_hit_callback();
+      return "";
+    }
+
+    hit_batch.batch_callback = batch_callback;
+    hit_batch.batch_size = batch_size;
+    if (hits != nullptr) {
+      // use the caller's array
+      hit_batch.hits = hits;
+      hit_batch.capacity = batch_size;
+    } else {
+      // use internal storage, reserving the batch size up front
+      hit_batch.storage.resize(batch_size);
+      hit_batch.hits = hit_batch.storage.data();
+      hit_batch.capacity = hit_batch.storage.size();
+    }
+    update_hit_callback();
+    return "";
   }
-}
 
+  // flush_hits
+  void lw_scanner_t::flush_hits() {
+    if (hit_records.record_callback != nullptr) {
+      if (hit_stats.is_enabled && hit_stats.is_callback_timed) {
+        stats_timer_t timer(hit_stats,
+                             &hit_stats.stats.callback_nanoseconds);
+        hit_records.flush();
+      } else {
+        hit_records.flush();
+      }
+    } else if (hit_batch.batch_callback != nullptr) {
+      if (hit_stats.is_enabled && hit_stats.is_callback_timed) {
+        stats_timer_t timer(hit_stats,
+                             &hit_stats.stats.callback_nanoseconds);
+        hit_batch.flush();
+      } else {
+        hit_batch.flush();
+      }
+    }
+  }
+
+  // update_hit_callback
+  void lw_scanner_t::update_hit_callback() {
+
+    // deliver hits to per-pattern callbacks or collect them into batches
+    // or records
+    if (hit_records.record_callback != nullptr) {
+      hit_callback = lightgrep_record_callback;
+      hit_callback_data = &hit_records;
+    } else if (hit_batch.batch_callback != nullptr) {
+      hit_callback = lightgrep_batch_callback;
+      hit_callback_data = &hit_batch;
+    } else {
+      hit_callback = lightgrep_callback;
+      hit_callback_data = &data_pair;
+    }
+
+    // count hits first
+    if (hit_stats.is_enabled) {
+      hit_stats.next_callback = hit_callback;
+      hit_stats.next_callback_data = hit_callback_data;
+      hit_callback = lightgrep_stats_callback;
+      hit_callback_data = &hit_stats;
+    }
+
+    // limit hits before they are counted
+    if (hit_limits.is_enabled()) {
+      hit_limits.next_callback = hit_callback;
+      hit_limits.next_callback_data = hit_callback_data;
+      hit_callback = lightgrep_limits_callback;
+      hit_callback_data = &hit_limits;
+    }
+
+    // filter hits before they are limited
+    if (hit_filter.mode != LW_FILTER_NONE) {
+      hit_filter.next_callback = hit_callback;
+      hit_filter.next_callback_data = hit_callback_data;
+      hit_callback = lightgrep_filter_callback;
+      hit_callback_data = &hit_filter;
+    }
+  }
+}
@@ -0,0 +1,200 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+/**
+ * \file
+ * C interface for the lightgrep_wrapper library, for use from C and from
+ * other languages through their foreign function interfaces.
+ *
+ * Usage:
+ *     1 - Create a program with lw_program_new.
+ *     2 - Add regular expressions with lw_program_add.
+ *     3 - Finalize the program with lw_program_finalize.
+ *     4 - Create one scanner per thread with lw_scanner_new.
+ *     5 - Scan buffers with lw_scan_buffer_into, which writes the buffer's
+ *         hits into your hit array in one call.
+ *     6 - Release scanners, then the program.
+ *
+ * Error text is kept by the program and is available from
+ * lw_program_error.  Pointers returned by this interface remain owned by
+ * the library.
+ */
+
+#ifndef LIGHTGREP_WRAPPER_H
+#define LIGHTGREP_WRAPPER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * The version of lightgrep_wrapper.
+ */
+const char* lightgrep_wrapper_version(void);
+
+/**
+ * A scan hit record.  The layout matches lw::lw_hit_t.
+ *
+ * Fields:
+ *   start - Start offset of the scan hit with respect to the beginning
+ *           of the scan stream.
+ *   size - The size of the scan hit data.
+ *   pattern_index - The index returned by lw_program_add for the pattern
+ *           that matched.
+ *   logical_index - The same as pattern_index for programs built with
+ *           this interface.
+ */
+typedef struct lw_c_hit {
+  uint64_t start;
+  uint64_t size;
+  uint32_t pattern_index;
+  uint32_t logical_index;
+} lw_c_hit_t;
+
+/**
+ * Opaque scanner program and scanner handles.
+ */
+typedef struct lw_c_program lw_c_program_t;
+typedef struct lw_c_scanner lw_c_scanner_t;
+
+/**
+ * Create an empty scanner program.
+ *
+ * Returns:
+ *   The program, or NULL if out of memory.
+ */
+lw_c_program_t* lw_program_new(void);
+
+/**
+ * Release a scanner program.  Release its scanners first.
+ */
+void lw_program_free(lw_c_program_t* program);
+
+/**
+ * Add a regular expression to scan for.
+ *
+ * Parameters:
+ *   program - The program, which must not be finalized.
+ *   regex - The regular expression text.
+ *   character_encoding - Encoding, for example UTF-8, UTF-16LE.
+ *   is_case_insensitive - Nonzero for upper/lower case insensitivity.
+ *   is_fixed_string - 0=grep, nonzero=fixed-string.
+ *
+ * Returns:
+ *   The pattern index reported in hits, or -1 on failure, in which case
+ *   lw_program_error describes the failure.
+ */
+int lw_program_add(lw_c_program_t* program,
+                   const char* regex,
+                   const char* character_encoding,
+                   int is_case_insensitive,
+                   int is_fixed_string);
+
+/**
+ * Finalize the program so that scanners may be created.
+ *
+ * Parameters:
+ *   program - The program.
+ *   is_determinized - 0=NFA, nonzero=DFA(pseudo).  Use 0.
+ *
+ * Returns:
+ *   0 on success or -1 on failure, in which case lw_program_error
+ *   describes the failure.
+ */
+int lw_program_finalize(lw_c_program_t* program, int is_determinized);
+
+/**
+ * The error text from the most recent failure on this program, or "".
+ */
+const char* lw_program_error(const lw_c_program_t* program);
+
+/**
+ * Create a scanner for a finalized program.
+ *
+ * Returns:
+ *   The scanner, or NULL if the program is not finalized or out of
+ *   memory.
+ */
+lw_c_scanner_t* lw_scanner_new(const lw_c_program_t* program);
+
+/**
+ * Release a scanner.
+ */
+void lw_scanner_free(lw_c_scanner_t* scanner);
+
+/**
+ * Discard any active scan state and any hits not yet taken so that the
+ * scanner can start a new stream.
+ */
+void lw_scanner_reset(lw_c_scanner_t* scanner);
+
+/**
+ * Scan the next buffer of a stream and write its hits into hits.
+ *
+ * Hits are written straight into hits as they are found, without an
+ * intermediate copy, when no hits from earlier calls are waiting.  Hits
+ * that do not fit are kept, in order, ahead of the hits of later
+ * calls.  Take them with lw_scanner_take_hits before scanning again if
+ * you need them before the next buffer is scanned.
+ *
+ * Parameters:
+ *   scanner - The scanner.
+ *   start - The offset of this buffer with respect to the beginning of
+ *           the scan stream.
+ *   buffer - The data to scan.
+ *   size - The size of the data.
+ *   is_final - Nonzero to finalize the stream after this buffer, which
+ *           reports matches that end at the end of the stream.
+ *   hits - The caller's hit array.
+ *   capacity - The number of hits that hits can hold.
+ *
+ * Returns:
+ *   The number of hits written into hits.
+ */
+size_t lw_scan_buffer_into(lw_c_scanner_t* scanner,
+                           uint64_t start,
+                           const char* buffer,
+                           size_t size,
+                           int is_final,
+                           lw_c_hit_t* hits,
+                           size_t capacity);
+
+/**
+ * Take hits that did not fit into the hit array of lw_scan_buffer_into.
+ *
+ * Returns:
+ *   The number of hits written into hits, 0 when none remain.
+ */
+size_t lw_scanner_take_hits(lw_c_scanner_t* scanner,
+                            lw_c_hit_t* hits,
+                            size_t capacity);
+
+/**
+ * The number of hits waiting to be taken.
+ */
+size_t lw_scanner_pending_hits(const lw_c_scanner_t* scanner);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
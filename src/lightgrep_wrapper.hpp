@@ -27,7 +27,9 @@
  *     3 - When done adding definitions, finalize your scanner program.
  *     4 - Once finalized, create lw_scanner_t instances to scan data for
            the regular expressions you compiled in your scanner program.
- *         Scanners are threadsafe, so get one per CPU for parallelization.
+ *         Scanners are threadsafe, so get one per CPU for parallelization,
+ *         or use lw_parallel_scanner_t to scan one large buffer or file
+ *         across several threads.
  *     5 - Use lw_scanner_t interfaces to scan data for matches to regular
  *         expressions.  Use scan to scan a stream of data in buffer
  *         intervals.  Use scan_finalize scans for final matches.  Use
@@ -40,15 +42,19 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <sstream>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <utility>
 #include <stdint.h>
 #include <lightgrep/api.h>
 
-/**
- * The version of lightgrep_wrapper.
- */
-extern "C"
-const char* lightgrep_wrapper_version();
+// the C interface, which declares lightgrep_wrapper_version
+#include "lightgrep_wrapper.h"
 
 /**
  * This is the typedef for user-provided scan callback functions with
@@ -71,6 +77,109 @@ typedef void (*scan_callback_function_t)(const uint64_t start,
 
 namespace lw {
 
+  /**
+   * A scan hit record, used when delivering hits in batches.
+   *
+   * Fields:
+   *   start - Start offset of the scan hit with respect to the beginning
+   *           of the scan stream.
+   *   size - The size of the scan hit data.
+   *   pattern_index - The index of the pattern that matched, in the order
+   *           the pattern was added using add_regex, starting at 0.  A
+   *           regex added for several encodings has one pattern index per
+   *           encoding.
+   *   logical_index - The index of the regex that matched, in the order
+   *           it was added using add_regex, starting at 0.  A regex added
+   *           for several encodings has one logical index.
+   */
+  struct lw_hit_t {
+    uint64_t start;
+    uint64_t size;
+    uint32_t pattern_index;
+    uint32_t logical_index;
+  };
+
+  /**
+   * This is the typedef for user-provided batch callback functions with
+   * user data.
+   *
+   * Parameters:
+   *   hits - The hits in this batch, in the order they were found.
+   *           The array is valid only for the duration of the call.
+   *   count - The number of hits in this batch.
+   *   user_data - The user data provided to lw_scanner_t.
+   */
+  typedef void (*batch_callback_function_t)(const lw_hit_t* hits,
+                                            const size_t count,
+                                            void* user_data);
+
+  /**
+   * A scan hit with a copy of its match data and surrounding context,
+   * used when delivering hit records.  The data is owned by the scanner
+   * and is valid only for the duration of the record callback.
+   *
+   * Fields:
+   *   hit - The scan hit.
+   *   data_offset - The stream offset of the first byte of data.
+   *   data - The left context, match data, and right context.
+   *   data_size - The size of data, which is smaller than requested when
+   *           context is not available in the current or previous scan
+   *           buffer.
+   */
+  struct lw_hit_record_t {
+    lw_hit_t hit;
+    uint64_t data_offset;
+    const char* data;
+    size_t data_size;
+  };
+
+  /**
+   * This is the typedef for user-provided record callback functions with
+   * user data.
+   *
+   * Parameters:
+   *   records - The hit records in this batch, in the order they were
+   *           found.  The records and their data are valid only for the
+   *           duration of the call.
+   *   count - The number of hit records.
+   *   user_data - The user data provided to lw_scanner_t.
+   */
+  typedef void (*record_callback_function_t)(const lw_hit_record_t* records,
+                                             const size_t count,
+                                             void* user_data);
+
+  /**
+   * Scan statistics, available from lw_scanner_t when statistics are
+   * enabled.  Take a snapshot from each scanner and merge them to get
+   * totals across threads.
+   *
+   * Fields:
+   *   hit_counts - The number of hits for each pattern, indexed by the
+   *           order the pattern was added using add_regex.
+   *   bytes_scanned - The number of bytes provided to scan,
+   *           scan_fence_finalize, and the file scan functions.
+   *   bytes_skipped - The number of those bytes skipped as repeated
+   *           content.  See lw_scanner_t::set_run_skipping.
+   *   search_nanoseconds - Time spent in lightgrep searching, including
+   *           time spent in callbacks that lightgrep calls.
+   *   callback_nanoseconds - Time spent in your callback functions, if
+   *           callback timing is enabled, else 0.
+   */
+  class lw_scan_stats_t {
+    public:
+    std::vector<uint64_t> hit_counts;
+    uint64_t bytes_scanned;
+    uint64_t bytes_skipped;
+    uint64_t search_nanoseconds;
+    uint64_t callback_nanoseconds;
+    lw_scan_stats_t();
+
+    /**
+     * Add the statistics from other into these statistics.
+     */
+    void merge(const lw_scan_stats_t& other);
+  };
+
   // internal support structure
   typedef std::vector<scan_callback_function_t> function_pointers_t;
 //  typedef std::pair<function_pointers_t*, void*> data_pair_t;
@@ -82,13 +191,199 @@ namespace lw {
                 void* p_user_data);
   };
 
+  /**
+   * A regular expression definition, as provided to add_regex.
+   */
+  struct lw_regex_spec_t {
+    std::string regex;
+    std::string character_encoding;
+    bool is_case_insensitive;
+    bool is_fixed_string;
+    scan_callback_function_t f;
+  };
+
+  // internal support function for hashing the pattern set of a program
+  uint64_t hash_regex(uint64_t hash,
+                      const std::string& regex,
+                      const std::string& character_encoding,
+                      const bool is_case_insensitive,
+                      const bool is_fixed_string);
+
+  // internal support function for parsing a regex into a pattern handle
+  std::string parse_regex(LG_HPATTERN pattern_handle,
+                          const std::string& regex,
+                          const bool is_case_insensitive,
+                          const bool is_fixed_string);
+
+  // internal support function for the bytes per character of an encoding
+  unsigned int encoding_width(const std::string& character_encoding);
+
+  // internal support functions for creating lightgrep contexts
+  LG_ContextOptions create_context_options();
+  LG_HCONTEXT create_searcher(const LG_HPROGRAM program,
+                              const LG_ContextOptions& context_options);
+
+  // internal support structure for counting hits before passing them on
+  class hit_stats_t {
+    private:
+    // do not allow copy or assignment
+    hit_stats_t(const hit_stats_t&) = delete;
+    hit_stats_t& operator=(const hit_stats_t&) = delete;
+
+    public:
+    bool is_enabled;
+    bool is_callback_timed;
+    LG_HITCALLBACK_FN next_callback;
+    void* next_callback_data;
+    lw_scan_stats_t stats;
+    hit_stats_t();
+  };
+
+  /**
+   * Hit filter modes for lw_scanner_t::set_hit_filter.  Modes may be
+   * combined.
+   *
+   * Modes:
+   *   LW_FILTER_NONE - Report every hit.
+   *   LW_FILTER_DUPLICATES - Drop hits with the same start, size, and
+   *           pattern index as a recent hit, such as hits reported again
+   *           by overlapping scan windows.
+   *   LW_FILTER_LONGEST - Keep only the longest hit at each start offset,
+   *           the first one found when sizes are equal.
+   *   LW_FILTER_CONTAINED - Drop hits that lie fully inside another hit.
+   */
+  enum lw_hit_filter_mode_t {
+    LW_FILTER_NONE = 0,
+    LW_FILTER_DUPLICATES = 1,
+    LW_FILTER_LONGEST = 2,
+    LW_FILTER_CONTAINED = 4
+  };
+
+  // internal support structure for filtering hits in a sliding window
+  // before passing them on
+  class hit_filter_t {
+    private:
+    // do not allow copy or assignment
+    hit_filter_t(const hit_filter_t&) = delete;
+    hit_filter_t& operator=(const hit_filter_t&) = delete;
+
+    public:
+    unsigned int mode;
+    uint64_t window_size;
+    LG_HITCALLBACK_FN next_callback;
+    void* next_callback_data;
+    // held and reported hits, each ordered by start
+    std::deque<LG_SearchHit> pending;
+    std::deque<LG_SearchHit> recent;
+    uint64_t longest_hit_size;
+    hit_filter_t();
+    void add(const LG_SearchHit& hit);
+    void release(const uint64_t stream_end);
+    void release_all();
+    void end_stream();
+  };
+  void lightgrep_filter_callback(void* p_hit_filter, const LG_SearchHit* hit);
+
+  // internal support structure for limiting the hits passed on
+  class hit_limits_t {
+    private:
+    // do not allow copy or assignment
+    hit_limits_t(const hit_limits_t&) = delete;
+    hit_limits_t& operator=(const hit_limits_t&) = delete;
+
+    public:
+    uint64_t max_total_hits;
+    uint64_t max_pattern_hits;
+    uint64_t total_hits;
+    std::vector<uint64_t> pattern_hits;
+    size_t capped_pattern_count;
+    bool is_stopped;
+    bool is_stream_ended;
+    LG_HITCALLBACK_FN next_callback;
+    void* next_callback_data;
+    hit_limits_t();
+    bool is_enabled() const;
+    void clear();
+  };
+  void lightgrep_limits_callback(void* p_hit_limits, const LG_SearchHit* hit);
+
+  // internal support structure for collecting hits into batches
+  class hit_batch_t {
+    private:
+    // do not allow copy or assignment
+    hit_batch_t(const hit_batch_t&) = delete;
+    hit_batch_t& operator=(const hit_batch_t&) = delete;
+
+    public:
+    batch_callback_function_t batch_callback;
+    void* user_data;
+    const std::vector<uint32_t>* logical_indices;
+    std::vector<lw_hit_t> storage;
+    lw_hit_t* hits;
+    size_t capacity;
+    size_t batch_size;
+    size_t count;
+    hit_batch_t();
+    void flush();
+  };
+
+  // internal support structure for bump-pointer allocation that is
+  // released all at once
+  class hit_arena_t {
+    public:
+    std::vector<std::vector<char> > blocks;
+    size_t current;
+    size_t used;
+    hit_arena_t();
+    char* allocate(const size_t size);
+    void reset();
+  };
+
+  // internal support structure for collecting hits with their context
+  class hit_records_t {
+    private:
+    // do not allow copy or assignment
+    hit_records_t(const hit_records_t&) = delete;
+    hit_records_t& operator=(const hit_records_t&) = delete;
+
+    public:
+    record_callback_function_t record_callback;
+    void* user_data;
+    const std::vector<uint32_t>* logical_indices;
+    size_t left_context_size;
+    size_t right_context_size;
+    size_t batch_size;
+    std::vector<lw_hit_record_t> records;
+    hit_arena_t arena;
+
+    // the buffers that hits may be in
+    uint64_t previous_offset;
+    const char* previous_buffer;
+    size_t previous_size;
+    uint64_t buffer_offset;
+    const char* buffer;
+    size_t buffer_size;
+
+    hit_records_t();
+    void set_buffer(const uint64_t offset, const char* const p_buffer,
+                    const size_t size);
+    void clear_buffers();
+    void flush();
+  };
+  void lightgrep_record_callback(void* p_hit_records, const LG_SearchHit* hit);
+
   /**
    * Build a scanner program instance to provide to your scanner.
    */
   class lw_scanner_program_t {
 
-    // the scanner accesses the program handle and function pointers
+    // the scanners access the program handle and function pointers
     friend class lw_scanner_t;
+    friend class lw_parallel_scanner_t;
+    friend class lw_scanner_pool_t;
+    friend class lw_sharded_scanner_t;
+    friend class lw_scan_pipeline_t;
+    template <typename Handler> friend class basic_scanner;
 
     private:
     LG_HPATTERN     pattern_handle;
@@ -96,13 +391,52 @@ namespace lw {
     LG_HPATTERNMAP  pattern_map;
     LG_HPROGRAM     program;
 
-    // the scan callback function pointers
+    // the scan callback function pointers, one per logical pattern
     std::vector<scan_callback_function_t> function_pointers;
 
+    // the logical index and encoding of each pattern index
+    std::vector<uint32_t> logical_indices;
+    std::vector<std::string> pattern_encodings;
+
+    // the scan callback function pointer of each pattern index, set once
+    // the program is finalized so that hits need one lookup
+    std::vector<scan_callback_function_t> pattern_function_pointers;
+
+    // hash of the regex definitions and program options, keys saved programs
+    uint64_t pattern_set_hash;
+
+    // the possible first bytes and the longest byte size of literal
+    // patterns, for skipping data where no pattern can start.  Empty when
+    // some pattern is not a literal.
+    std::vector<unsigned char> prefilter_bytes;
+    size_t prefilter_max_size;
+    bool is_prefilterable;
+
     // do not allow copy or assignment
     lw_scanner_program_t(const lw_scanner_program_t&) = delete;
     lw_scanner_program_t& operator=(const lw_scanner_program_t&) = delete;
 
+    // add a regex that has been parsed into parsed_pattern_handle
+    std::string add_parsed_regex(LG_HPATTERN parsed_pattern_handle,
+                                 const std::string& regex,
+                                 const std::string& character_encoding,
+                                 const bool is_case_insensitive,
+                                 const bool is_fixed_string,
+                                 const scan_callback_function_t f,
+                                 const uint32_t logical_index);
+
+    // include a regex in the prefilter, or disable the prefilter
+    void update_prefilter(const std::string& regex,
+                          const std::string& character_encoding,
+                          const bool is_case_insensitive,
+                          const bool is_fixed_string);
+
+    // keep the prefilter only if it can skip data
+    void finish_prefilter();
+
+    // set the callback function pointer of each pattern index
+    void finish_function_pointers();
+
     public:
     /**
      * Begin a scanner program instance.
@@ -134,6 +468,69 @@ namespace lw {
                           const bool is_fixed_string,
                           scan_callback_function_t f);
 
+    /**
+     * Add a regular expression to scan for in several encodings.  The
+     * regex is parsed once and added to the same automaton once per
+     * encoding, as one logical pattern with one callback function slot.
+     * Each encoding gets its own pattern index, so hits and scan
+     * statistics tell which encoding matched.  Use logical_pattern_index
+     * and pattern_encoding to map a pattern index back.  The callback
+     * function is called with the match but not the encoding, so use a
+     * batch or record callback, whose hits carry the pattern index, to
+     * tell encodings apart.
+     *
+     * Parameters:
+     *   regex - The regular expression text.
+     *   character_encodings - Encodings, for example UTF-8, UTF-16LE,
+     *           UTF-16BE.
+     *   is_case_insensitive - Select upper/lower case insensitivity.
+     *   is_fixed_string - false=grep, true=fixed-string.  Use false.
+     *   callback_function - The function to call to service hits associated
+     *                       with this regular expression in any encoding.
+     *
+     * Returns:
+     *   "" if accepted for all encodings else error text, one line per
+     *   failure.  Encodings that fail are skipped.
+     */
+    std::string add_regex(const std::string& regex,
+                          const std::vector<std::string>& character_encodings,
+                          const bool is_case_insensitive,
+                          const bool is_fixed_string,
+                          scan_callback_function_t f);
+
+    /**
+     * The number of logical patterns added.
+     */
+    size_t logical_pattern_count() const;
+
+    /**
+     * The logical index of a pattern index.
+     */
+    uint32_t logical_pattern_index(const size_t pattern_index) const;
+
+    /**
+     * The character encoding of a pattern index.
+     */
+    const std::string& pattern_encoding(const size_t pattern_index) const;
+
+    /**
+     * Add many regular expressions to scan for.  Regular expressions are
+     * parsed and validated in parallel, then added in order, so pattern
+     * indices are the same as if each had been added using add_regex.
+     * When these are the first regular expressions added, the program's
+     * automaton and pattern map are sized from them.  Regular expressions
+     * that fail are skipped.
+     *
+     * Parameters:
+     *   regex_specs - The regular expression definitions.
+     *   thread_count - The number of threads to parse with.
+     *
+     * Returns:
+     *   "" if all are accepted else error text, one line per failure.
+     */
+    std::string add_regexes(const std::vector<lw_regex_spec_t>& regex_specs,
+                            const size_t thread_count);
+
     /**
      * Finalize the regular expression scanner program used for scanning.
      * Once finalized, the program becomes valid, cannot be changed, and
@@ -144,6 +541,76 @@ namespace lw {
      *                     liblightgrep.
      */
     void finalize_program(bool is_determinized);
+
+    /**
+     * Whether scanners skip data using a prefilter.  When every pattern is
+     * a literal, either a fixed string or a regex without special
+     * characters, in UTF-8, ASCII, UTF-16LE, or UTF-16BE, and its first
+     * character is ASCII, finalize_program builds a table of the bytes
+     * that patterns can start with.  lw_scanner_t then searches only the
+     * data near those bytes and closes out the search across long runs of
+     * other bytes.
+     *
+     * Returns:
+     *   True if the program is finalized and uses a prefilter.
+     */
+    bool is_prefiltered() const;
+
+    /**
+     * Finalize several independent scanner programs concurrently, for
+     * example the shards of a large pattern set.
+     *
+     * Parameters:
+     *   scanner_programs - The scanner programs to finalize.
+     *   is_determinized - See finalize_program.
+     *   thread_count - The maximum number of programs to finalize at once.
+     */
+    static void finalize_programs(
+                     const std::vector<lw_scanner_program_t*>& scanner_programs,
+                     const bool is_determinized,
+                     const size_t thread_count);
+
+    /**
+     * Save the finalized program to a file so that it can be loaded
+     * using load instead of being compiled again.  The file is keyed by
+     * a hash of the regular expression definitions and program options,
+     * and is only valid on the same architecture and lightgrep version
+     * that saved it.  The file is created readable and writable by its
+     * owner only, mode 0600, so change its mode to share it.
+     *
+     * Parameters:
+     *   filename - The file to save the program to.
+     *
+     * Returns:
+     *   "" if saved else error text on failure.
+     */
+    std::string save(const std::string& filename) const;
+
+    /**
+     * Load a program saved using save instead of adding regular
+     * expressions and finalizing.  The load fails if the file was not
+     * saved from the same regular expression definitions, in the same
+     * order, with the same is_determinized setting.  On failure, add the
+     * definitions and finalize the program as usual.
+     *
+     * Parameters:
+     *   filename - The file to load the program from.
+     *   regex_specs - The regular expression definitions, one per
+     *           pattern index in the order they were added when the
+     *           program was saved.  List a regex added for several
+     *           encodings once per encoding, in the order of its
+     *           encodings.  The grouping of encodings into logical
+     *           patterns is restored from the file, and each logical
+     *           pattern takes its callback function from its first
+     *           definition.
+     *   is_determinized - The setting used when the program was saved.
+     *
+     * Returns:
+     *   "" if loaded else error text on failure.
+     */
+    std::string load(const std::string& filename,
+                     const std::vector<lw_regex_spec_t>& regex_specs,
+                     const bool is_determinized);
   };
 
   /**
@@ -151,15 +618,64 @@ namespace lw {
    */
   class lw_scanner_t {
 
+    // the multistream scanner replays saved stream data into the context
+    friend class lw_multistream_scanner_t;
+
     private:
     const LG_ContextOptions context_options;
     const LG_HCONTEXT searcher;
     data_pair_t data_pair;
+    hit_batch_t hit_batch;
+    hit_stats_t hit_stats;
+    hit_filter_t hit_filter;
+    hit_records_t hit_records;
+    hit_limits_t hit_limits;
+
+    // the program's prefilter, or nullptr, and the prefilter search state
+    const unsigned char* prefilter_bytes;
+    const size_t prefilter_max_size;
+    uint64_t prefilter_live_end;
+    bool is_search_active;
+
+    // repeated content skipping
+    size_t skip_run_size;
+    size_t skip_fence_size;
+
+    // the lightgrep callback and its data, which depend on the hit mode
+    LG_HITCALLBACK_FN hit_callback;
+    void* hit_callback_data;
+
+    // the file data available to callbacks during scan_file and scan_fd
+    const char* file_data;
+    uint64_t file_data_offset;
+    size_t file_data_size;
 
     // do not allow copy or assignment
     lw_scanner_t(const lw_scanner_t&) = delete;
     lw_scanner_t& operator=(const lw_scanner_t&) = delete;
 
+    // deliver any hits collected in batch mode
+    void flush_hits();
+
+    // set hit_callback and hit_callback_data for the hit modes in use
+    void update_hit_callback();
+
+    // search only the data near bytes that patterns can start with
+    void search_prefiltered(const uint64_t stream_offset,
+                            const char* const buffer, const size_t size);
+
+    // search data, using the prefilter if the program has one
+    void search(const uint64_t stream_offset,
+                const char* const buffer, const size_t size);
+
+    // search data, skipping runs of repeated blocks
+    void search_skipping_runs(const uint64_t stream_offset,
+                              const char* const buffer, const size_t size);
+
+    // search data, skipping runs of repeated blocks if enabled
+    void search_buffer(const uint64_t stream_offset,
+                       const char* const buffer, const size_t size);
+
     public:
 
     /**
@@ -228,29 +744,1429 @@ namespace lw {
      */
     void scan_fence_finalize(uint64_t stream_offset,
                              const char* const buffer, size_t size);
+
+    /**
+     * Deliver hits in batches to one batch callback function instead of
+     * calling the per-pattern callback function for each hit.  Hits are
+     * collected into a contiguous array and delivered when the array is
+     * full and at the end of each scan, scan_finalize, and
+     * scan_fence_finalize call.
+     *
+     * Parameters:
+     *   batch_callback - The function to call with each batch of hits,
+     *           or nullptr to restore per-pattern callbacks.
+     *   batch_size - The maximum number of hits per batch, or 0 to
+     *           deliver all hits found by a scan call in one batch.
+     *   hits - An array of at least batch_size hits for collecting hits
+     *           into, or nullptr to use storage that the scanner owns
+     *           and reuses.  batch_size may not be 0 when providing hits.
+     *
+     * Returns:
+     *   "" if accepted else error text on failure.
+     */
+    std::string set_batch_callback(batch_callback_function_t batch_callback,
+                                   const size_t batch_size,
+                                   lw_hit_t* const hits = nullptr);
+
+    /**
+     * Scan a file or block device as one complete stream starting at
+     * stream offset 0, then finalize the scan.  The file is memory-mapped
+     * when possible, else it is read in large blocks.  Use read_file_data
+     * from your callback functions to access match data without copying.
+     *
+     * Parameters:
+     *   filename - The file or block device to scan.
+     *
+     * Returns:
+     *   "" if scanned else error text on failure.
+     */
+    std::string scan_file(const std::string& filename);
+
+    /**
+     * Scan an open file descriptor from its start as one complete stream
+     * starting at stream offset 0, then finalize the scan.  See scan_file.
+     *
+     * Parameters:
+     *   fd - The open file descriptor to scan.  It is not closed.
+     *
+     * Returns:
+     *   "" if scanned else error text on failure.
+     */
+    std::string scan_fd(const int fd);
+
+    /**
+     * Get a pointer to file data while scan_file or scan_fd is running.
+     * Call this from your callback functions to access match data in
+     * place.  When the file is memory-mapped, all of the file is
+     * available.  When it is read in blocks, the current block and the
+     * 1MiB before it are available.
+     *
+     * Parameters:
+     *   start - The stream offset of the data.
+     *   size - The size, in bytes, of the data.
+     *
+     * Returns:
+     *   A pointer to the data, or nullptr if the data is not available.
+     */
+    const char* read_file_data(const uint64_t start,
+                               const uint64_t size) const;
+
+    /**
+     * Start keeping scan statistics.  Counting hits and bytes is cheap.
+     * Timing callbacks reads the clock twice per hit, so enable it only
+     * when needed.
+     *
+     * Parameters:
+     *   is_callback_timed - True to also time your callback functions.
+     */
+    void enable_stats(const bool is_callback_timed);
+
+    /**
+     * Stop keeping scan statistics.  Statistics kept so far are retained.
+     */
+    void disable_stats();
+
+    /**
+     * Get a snapshot of the scan statistics.
+     */
+    lw_scan_stats_t stats() const;
+
+    /**
+     * Clear the scan statistics.
+     */
+    void reset_stats();
+
+    /**
+     * Filter hits before they are reported.  Hits are held in a sliding
+     * window of window_size bytes behind the end of the data scanned so
+     * far, so that a later, longer, or enclosing hit can replace them, and
+     * are remembered for a further window_size bytes to catch duplicates.
+     * Held hits are reported once the scan moves past them, or by
+     * scan_finalize and scan_fence_finalize, so set window_size to at
+     * least the longest expected match and the largest window overlap.
+     * Recent hits are forgotten when the stream ends, so a scanner reused
+     * for a new stream reports its hits afresh.
+     * Scan statistics count the hits that are reported.
+     *
+     * Parameters:
+     *   mode - A combination of lw_hit_filter_mode_t modes, or
+     *           LW_FILTER_NONE to stop filtering.
+     *   window_size - The size, in bytes, of the sliding window.
+     *
+     * Returns:
+     *   "" if set else error text on failure.
+     */
+    std::string set_hit_filter(const unsigned int mode,
+                               const uint64_t window_size);
+
+    /**
+     * Deliver hits as records that carry a copy of the match data and of
+     * up to left_context_size bytes before and right_context_size bytes
+     * after it, in batches, instead of calling per-pattern callback
+     * functions or a batch callback function.  The copies are made into
+     * an arena owned by the scanner, which is reset in one step after
+     * each batch, so no memory is allocated per hit once the arena has
+     * grown to fit a batch.
+     *
+     * Context is copied from the buffer being scanned and the buffer
+     * given to the previous scan call, so keep the previous buffer valid
+     * until the next scan call returns.  Right context past the end of
+     * the data scanned so far is not available.
+     *
+     * Parameters:
+     *   record_callback - Your record callback function, or nullptr to
+     *           return to per-pattern or batch callback functions.
+     *   left_context_size - Bytes of context to copy before each match.
+     *   right_context_size - Bytes of context to copy after each match.
+     *   batch_size - The maximum number of records per batch, or 0 to
+     *           deliver one batch at the end of each scan call.
+     */
+    void set_record_callback(record_callback_function_t record_callback,
+                             const size_t left_context_size,
+                             const size_t right_context_size,
+                             const size_t batch_size);
+
+    /**
+     * Limit the hits reported for each stream, and stop scanning the
+     * stream early once no more hits can be reported.  Use a
+     * max_total_hits of 1 to stop at the first hit.  A pattern that
+     * reaches max_pattern_hits is muted, and scanning stops when every
+     * pattern is muted.  While limits are set, scan searches in slices of
+     * 64KiB and returns after the slice in which scanning stopped, and
+     * scan_file and scan_fd stop reading.
+     *
+     * Counts start over with the first scan after scan_finalize,
+     * scan_fence_finalize, or reset, so is_stopped describes the stream
+     * just finalized until then.  scan_fence_finalize does not search
+     * the fence of a stopped stream.
+     *
+     * Parameters:
+     *   max_total_hits - The maximum number of hits to report, or 0 for
+     *           no limit.
+     *   max_pattern_hits - The maximum number of hits to report for each
+     *           pattern, or 0 for no limit.
+     */
+    void set_hit_limits(const uint64_t max_total_hits,
+                        const uint64_t max_pattern_hits);
+
+    /**
+     * Whether the hit limits stopped scanning of the stream.
+     */
+    bool is_stopped() const;
+
+    /**
+     * Skip long runs of repeated content, such as zero-filled or
+     * repeated sectors in disk images.  scan compares each 512-byte block
+     * of a buffer with the block before it, and skips runs of identical
+     * blocks of at least min_run_size bytes, keeping the first block.
+     * Before a skip, the search is resolved across fence_size bytes of
+     * the run and closed out, then it resumes at the end of the run, so
+     * hit offsets stay exact.  Hits that start inside a skipped run, or
+     * that extend more than fence_size bytes into it, are not reported.
+     *
+     * Parameters:
+     *   min_run_size - The shortest run to skip, at least 1024 bytes, or
+     *           0 to stop skipping.
+     *   fence_size - The number of bytes of a run to resolve matches
+     *           across before skipping it.
+     *
+     * Returns:
+     *   "" if set else error text on failure.
+     */
+    std::string set_run_skipping(const size_t min_run_size,
+                                 const size_t fence_size);
+
+    /**
+     * Discard any active scan state so that the scanner can start a new
+     * stream, and use user_data for subsequent callbacks.  Hits from the
+     * discarded scan are not reported.  The scanner's lightgrep context
+     * is reused rather than recreated.
+     *
+     * Parameters:
+     *   user_data - The user data that this scanner will use.
+     */
+    void reset(void* user_data);
   };
 
+  class lw_scanner_pool_t;
+
   /**
-   * This convenience function provides a read service for reading
-   * match data in a streaming context.  You provide the buffer
-   * and the previous buffer to read from, the offset to the buffer,
-   * the offset and length of where to read, and any requested
-   * additional padding to read.  The returned data may be smaller
-   * than requested if the span requested is outside the bounds of
-   * the two buffers you provide.
-   *
-   * Two buffers are provided to support stream scanning, where scans
-   * started in one buffer may not be identified until scanning
-   * in the next buffer.  It is your responsibility to provide a large
-   * enough previous buffer in order to read all requested bytes.
-   *
-   * Parameters:
-   *   buffer_offset - The offset to your buffer.
-   *   previous_buffer - The buffer adjacent but before your buffer.
-   *   previous_buffer_size - The size, in bytes, of your previous buffer.
-   *   buffer - The buffer that backs your data being scanned.
-   *   buffer_size - The size, in bytes, of your buffer.
-   *   offset - The offset to the data to read.
+   * A lease on a scanner from a lw_scanner_pool_t.  The scanner is
+   * returned to the pool when the lease is destroyed.  Leases may be
+   * moved but not copied.
+   */
+  class lw_scanner_lease_t {
+
+    private:
+    lw_scanner_pool_t* pool;
+    lw_scanner_t* scanner;
+
+    // do not allow copy or assignment
+    lw_scanner_lease_t(const lw_scanner_lease_t&) = delete;
+    lw_scanner_lease_t& operator=(const lw_scanner_lease_t&) = delete;
+
+    public:
+    lw_scanner_lease_t(lw_scanner_pool_t* p_pool, lw_scanner_t* p_scanner);
+    lw_scanner_lease_t(lw_scanner_lease_t&& other);
+    ~lw_scanner_lease_t();
+
+    /**
+     * The leased scanner.
+     */
+    lw_scanner_t& operator*() const {
+      return *scanner;
+    }
+    lw_scanner_t* operator->() const {
+      return scanner;
+    }
+  };
+
+  /**
+   * A thread-safe pool of scanners for one scanner program.  Use it to
+   * reuse scanners, and their lightgrep contexts, across many short
+   * scan jobs instead of creating a scanner for each job.  The pool must
+   * outlive its leases.
+   */
+  class lw_scanner_pool_t {
+
+    // leases return scanners to the pool
+    friend class lw_scanner_lease_t;
+
+    private:
+    const lw_scanner_program_t& scanner_program;
+    std::mutex scanners_mutex;
+    std::vector<lw_scanner_t*> available_scanners;
+    size_t scanner_count;
+
+    // do not allow copy or assignment
+    lw_scanner_pool_t(const lw_scanner_pool_t&) = delete;
+    lw_scanner_pool_t& operator=(const lw_scanner_pool_t&) = delete;
+
+    // return a scanner to the pool
+    void release(lw_scanner_t* scanner);
+
+    public:
+
+    /**
+     * True when the scanner program has been finalized.  The scanners
+     * will fail if the scanner program has not been finalized.
+     */
+    const bool program_is_finalized;
+
+    /**
+     * Create a scanner pool.
+     *
+     * Parameters:
+     *   scanner_program - The finalized scanner program.
+     *   initial_count - The number of scanners to create up front.  More
+     *           are created as needed.
+     */
+    lw_scanner_pool_t(const lw_scanner_program_t& scanner_program,
+                      const size_t initial_count);
+
+    /**
+     * Release resources.  All leases must have been destroyed.
+     */
+    ~lw_scanner_pool_t();
+
+    /**
+     * Lease a scanner that is reset to start a new stream using
+     * user_data.  Scanners are returned with per-pattern callbacks,
+     * statistics disabled, and no hit filter, hit limits, or run
+     * skipping.
+     *
+     * Parameters:
+     *   user_data - The user data that the scanner will use.
+     *
+     * Returns:
+     *   The lease on the scanner.
+     */
+    lw_scanner_lease_t acquire(void* user_data);
+
+    /**
+     * The number of scanners that the pool has created.
+     */
+    size_t size();
+  };
+
+  /**
+   * A scanner that calls Handler::on_hit directly for each hit instead of
+   * calling through the per-pattern callback function pointers, allowing
+   * the compiler to inline your hit handling into the lightgrep callback.
+   * It works like lw_scanner_t, but the callback function pointers in the
+   * scanner program are not used.
+   *
+   * Handler must provide:
+   *   void on_hit(const uint32_t pattern_index,
+   *               const uint64_t start,
+   *               const uint64_t size);
+   * where pattern_index is the index of the pattern in the order it was
+   * added using add_regex, starting at 0.
+   *
+   * Use callable_handler_t to use a lambda or function object as the
+   * handler.
+   */
+  template <typename Handler>
+  class basic_scanner {
+
+    private:
+    const LG_ContextOptions context_options;
+    const LG_HCONTEXT searcher;
+
+    // do not allow copy or assignment
+    basic_scanner(const basic_scanner&) = delete;
+    basic_scanner& operator=(const basic_scanner&) = delete;
+
+    // lightgrep callback function
+    static void lightgrep_callback(void* p_handler, const LG_SearchHit* hit) {
+      static_cast<Handler*>(p_handler)->on_hit(hit->KeywordIndex,
+                                               hit->Start,
+                                               hit->End - hit->Start);
+    }
+
+    public:
+
+    /**
+     * The handler that services hits.
+     */
+    Handler handler;
+
+    /**
+     * True when the scanner program has been finalized.  The scanner will
+     * fail if the scanner program has not been finalized.
+     */
+    const bool program_is_finalized;
+
+    /**
+     * Instantiate a scanner instance that you can use for scanning.
+     *
+     * Parameters:
+     *   scanner_program - The scanner program containing the regex program.
+     *   p_handler - The handler that this scanner copies and calls for
+     *           each hit.
+     */
+    basic_scanner(const lw_scanner_program_t& scanner_program,
+                  const Handler& p_handler) :
+               context_options(create_context_options()),
+               searcher(create_searcher(scanner_program.program,
+                                        context_options)),
+               handler(p_handler),
+               program_is_finalized(searcher != nullptr) {
+    }
+
+    ~basic_scanner() {
+      lg_destroy_context(searcher);
+    }
+
+    /**
+     * Scan bytes of data from a buffer.  See lw_scanner_t::scan.
+     */
+    void scan(uint64_t stream_offset, const char* const buffer, size_t size) {
+
+      // lg doesn't like an empty buffer
+      if (size == 0) {
+        return;
+      }
+
+      lg_search(searcher, buffer, buffer + size, stream_offset,
+                &handler, lightgrep_callback);
+    }
+
+    /**
+     * End scanning.  See lw_scanner_t::scan_finalize.
+     */
+    void scan_finalize() {
+      lg_closeout_search(searcher, &handler, lightgrep_callback);
+      lg_reset_context(searcher);
+    }
+
+    /**
+     * Scan across a fence then end scanning.
+     * See lw_scanner_t::scan_fence_finalize.
+     */
+    void scan_fence_finalize(uint64_t stream_offset,
+                             const char* const buffer, size_t size) {
+
+      // lg doesn't like an empty buffer
+      if (size != 0) {
+        lg_search_resolve(searcher, buffer, buffer + size, stream_offset,
+                          &handler, lightgrep_callback);
+      }
+      lg_closeout_search(searcher, &handler, lightgrep_callback);
+      lg_reset_context(searcher);
+    }
+  };
+
+  /**
+   * A basic_scanner handler that calls a lambda or function object taking
+   * (pattern_index, start, size).  For example:
+   *
+   *   auto f = [&](uint32_t pattern_index, uint64_t start, uint64_t size) {
+   *     ...
+   *   };
+   *   lw::basic_scanner<lw::callable_handler_t<decltype(f)> >
+   *                                        scanner(scanner_program, f);
+   */
+  template <typename F>
+  class callable_handler_t {
+    private:
+    F f;
+
+    public:
+    callable_handler_t(const F& p_f) : f(p_f) {
+    }
+
+    void on_hit(const uint32_t pattern_index,
+                const uint64_t start,
+                const uint64_t size) {
+      f(pattern_index, start, size);
+    }
+  };
+
+  /**
+   * A multi-threaded scanner that scans one large buffer or file by
+   * partitioning it into chunks and scanning the chunks in parallel.
+   *
+   * Each thread owns one lw_scanner_t.  A thread scans its chunk using
+   * scan and then uses scan_fence_finalize to scan past the end of its
+   * chunk, so matches that start in the chunk but span into the next
+   * chunk are reported by this chunk, and matches that start in the
+   * next chunk are left for the next chunk.  In this way each match is
+   * reported exactly once.
+   *
+   * Callbacks run concurrently, so provide one user_data instance for
+   * each thread.  Callbacks for a given user_data instance are never
+   * called concurrently.
+   *
+   * On multi-socket hosts, request NUMA-local scanning so that threads
+   * do not read the automaton across the interconnect.  Threads are then
+   * assigned to NUMA nodes in turn, each node gets its own copy of the
+   * compiled program and its scanners in its own memory, and each thread
+   * runs only on the CPUs of its node.  scan_file reads each chunk into
+   * memory local to the thread that scans it.
+   */
+  class lw_parallel_scanner_t {
+
+    private:
+    const size_t chunk_size;
+    const size_t fence_size;
+    std::vector<lw_scanner_t*> scanners;
+
+    // with NUMA-local scanning, the program copy and the CPUs of each
+    // node, and the node of each scanner
+    std::vector<lw_scanner_program_t*> node_programs;
+    std::vector<std::vector<int> > node_cpus;
+    std::vector<size_t> scanner_nodes;
+
+    // do not allow copy or assignment
+    lw_parallel_scanner_t(const lw_parallel_scanner_t&) = delete;
+    lw_parallel_scanner_t& operator=(const lw_parallel_scanner_t&) = delete;
+
+    // on a thread running on the node, copy the program into the node's
+    // memory and create the node's scanners
+    void build_node(const size_t node,
+                    const lw_scanner_program_t* scanner_program,
+                    const std::vector<char>* program_bytes,
+                    const std::vector<void*>* user_data);
+
+    // the CPUs that the thread of scanner i runs on, or nullptr for any
+    const std::vector<int>* scanner_cpus(const size_t i) const;
+
+    public:
+
+    /**
+     * True when the scanner program has been finalized.  The scanner will
+     * fail if the scanner program has not been finalized.
+     */
+    const bool program_is_finalized;
+
+    /**
+     * Instantiate a parallel scanner with one lw_scanner_t per thread.
+     *
+     * Parameters:
+     *   scanner_program - The finalized scanner program.
+     *   user_data - The user data for each thread, one per thread.
+     *           The number of threads is the size of this list.
+     *   chunk_size - The size, in bytes, of each chunk to scan.
+     *   fence_size - The maximum number of bytes to read past the end of
+     *           a chunk when scanning a file in order to complete matches
+     *           that span across the chunk boundary.  Buffer scans use
+     *           the rest of the buffer.
+     *   is_numa_local - True to copy the program into each NUMA node's
+     *           memory and keep each thread on its node's CPUs.  Ignored
+     *           when the NUMA nodes cannot be found.
+     */
+    lw_parallel_scanner_t(const lw_scanner_program_t& scanner_program,
+                          const std::vector<void*>& user_data,
+                          const size_t chunk_size,
+                          const size_t fence_size,
+                          const bool is_numa_local = false);
+
+    ~lw_parallel_scanner_t();
+
+    /**
+     * The number of NUMA nodes that threads are assigned to, or 0 if
+     * NUMA-local scanning is not in use.
+     */
+    size_t numa_node_count() const;
+
+    /**
+     * Scan a buffer in parallel.  The buffer is scanned as one complete
+     * stream, so matches active at the end of the buffer are finalized.
+     *
+     * Parameters:
+     *   stream_offset - The offset into the stream to the start of the buffer.
+     *   buffer - The buffer to scan.
+     *   size - The size, in bytes, of the buffer to scan.
+     *
+     * Returns:
+     *   Nothing, but the associated callback function is called for each
+     *   match, with the user data of the thread that found it.
+     */
+    void scan(uint64_t stream_offset, const char* const buffer, size_t size);
+
+    /**
+     * Scan a file or block device in parallel.  Each thread reads its
+     * chunks using its own buffer, so callbacks receive the offset and
+     * size of matches but cannot read match data from a buffer.
+     *
+     * Parameters:
+     *   filename - The file or block device to scan.
+     *
+     * Returns:
+     *   "" if scanned else error text on failure.
+     */
+    std::string scan_file(const std::string& filename);
+  };
+
+  /**
+   * A scanner program split into shards, each its own lw_scanner_program_t,
+   * so that each shard's automaton stays small enough to be cache-resident
+   * and peak memory stays bounded for large pattern sets.  Patterns are
+   * assigned to shards by estimated automaton cost, which accounts for
+   * regex size, encoding width, and case folding.  Use
+   * lw_sharded_scanner_t to scan with all shards.
+   */
+  class lw_sharded_program_t {
+
+    // the scanner accesses the shards and pattern index maps
+    friend class lw_sharded_scanner_t;
+
+    private:
+    std::vector<lw_scanner_program_t*> shards;
+
+    // shard pattern index to original pattern index, for each shard
+    std::vector<std::vector<uint32_t> > pattern_indices;
+
+    // the scan callback function pointers in original pattern order
+    std::vector<scan_callback_function_t> function_pointers;
+
+    // do not allow copy or assignment
+    lw_sharded_program_t(const lw_sharded_program_t&) = delete;
+    lw_sharded_program_t& operator=(const lw_sharded_program_t&) = delete;
+
+    public:
+    /**
+     * Begin a sharded scanner program instance.
+     *
+     * Parameters:
+     *   shard_count - The number of shards to split patterns across.
+     */
+    lw_sharded_program_t(const size_t shard_count);
+
+    /**
+     * Release resources.
+     */
+    ~lw_sharded_program_t();
+
+    /**
+     * Add regular expressions to scan for, assigning them to shards.
+     * Shards are built concurrently.  Call once, with all definitions.
+     * Original pattern indices are the positions of the definitions in
+     * regex_specs.
+     *
+     * Parameters:
+     *   regex_specs - The regular expression definitions.
+     *
+     * Returns:
+     *   "" if all are accepted else error text, one line per failure.
+     */
+    std::string add_regexes(const std::vector<lw_regex_spec_t>& regex_specs);
+
+    /**
+     * Finalize all shards concurrently.  See
+     * lw_scanner_program_t::finalize_program.
+     *
+     * Parameters:
+     *   is_determinized - false=NFA, true=DFA(pseudo).
+     *   thread_count - The maximum number of shards to finalize at once.
+     */
+    void finalize_program(const bool is_determinized,
+                          const size_t thread_count);
+
+    /**
+     * The number of shards.
+     */
+    size_t shard_count() const;
+  };
+
+  /**
+   * A scanner that scans with every shard of a lw_sharded_program_t.
+   * Shards scan the same buffer one after another for cache locality, or
+   * concurrently on threads.  Either way, the hits found by each scan
+   * call are delivered on the calling thread after all shards finish,
+   * ordered by start offset then original pattern index, with pattern
+   * indices mapped back to the original order.
+   */
+  class lw_sharded_scanner_t {
+
+    private:
+    const lw_sharded_program_t& sharded_program;
+    void* user_data;
+    const bool is_threaded;
+    std::vector<std::vector<lw_hit_t> > shard_hits;
+    std::vector<lw_scanner_t*> scanners;
+    std::vector<lw_hit_t> hits;
+    batch_callback_function_t batch_callback;
+
+    // in threaded mode, a persistent worker thread for each shard scanner
+    // but the first, which scans on the calling thread, and the current
+    // task that the workers are woken to run
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable condition;
+    void (*task_function)(lw_scanner_t*, uint64_t, const char*, size_t);
+    uint64_t task_stream_offset;
+    const char* task_buffer;
+    size_t task_size;
+    uint64_t task_generation;
+    size_t tasks_remaining;
+    bool is_stopping;
+
+    // do not allow copy or assignment
+    lw_sharded_scanner_t(const lw_sharded_scanner_t&) = delete;
+    lw_sharded_scanner_t& operator=(const lw_sharded_scanner_t&) = delete;
+
+    // a worker thread's loop, running each task on one shard scanner
+    void work_loop(const size_t scanner_index);
+
+    // run a scan function on every shard scanner then deliver the hits
+    void scan_shards(void (*scan_function)(lw_scanner_t*, uint64_t,
+                                           const char*, size_t),
+                     uint64_t stream_offset,
+                     const char* const buffer, size_t size);
+
+    public:
+
+    /**
+     * True when all shards have been finalized.
+     */
+    const bool program_is_finalized;
+
+    /**
+     * Instantiate a sharded scanner.
+     *
+     * Parameters:
+     *   sharded_program - The finalized sharded program.
+     *   user_data - The user data that this scanner will use.
+     *   is_threaded - True to scan shards concurrently on worker threads
+     *           that live as long as the scanner, false to scan them one
+     *           after another.
+     */
+    lw_sharded_scanner_t(const lw_sharded_program_t& sharded_program,
+                         void* user_data,
+                         const bool is_threaded);
+
+    ~lw_sharded_scanner_t();
+
+    /**
+     * Scan bytes of data from a buffer.  See lw_scanner_t::scan.
+     */
+    void scan(uint64_t stream_offset, const char* const buffer, size_t size);
+
+    /**
+     * End scanning.  See lw_scanner_t::scan_finalize.
+     */
+    void scan_finalize();
+
+    /**
+     * Scan across a fence then end scanning.
+     * See lw_scanner_t::scan_fence_finalize.
+     */
+    void scan_fence_finalize(uint64_t stream_offset,
+                             const char* const buffer, size_t size);
+
+    /**
+     * Deliver the hits from each scan call in one batch, with original
+     * pattern indices, instead of calling per-pattern callback functions.
+     *
+     * Parameters:
+     *   batch_callback - The function to call with each batch of hits,
+     *           or nullptr to restore per-pattern callbacks.
+     */
+    void set_batch_callback(batch_callback_function_t batch_callback);
+  };
+
+  /**
+   * A three-stage scan pipeline that overlaps reading, scanning, and hit
+   * handling.  A reader thread reads the input sequentially into pooled
+   * buffers, worker threads scan the buffers, and a sink thread delivers
+   * each buffer's hits to your batch callback function.  The stages are
+   * linked by bounded queues, so a slow stage applies backpressure
+   * instead of growing memory.  A stage that finds its queue full or
+   * empty spins briefly, then blocks on a condition variable until
+   * another stage makes room or adds work.
+   *
+   * Each buffer holds a chunk plus the fence bytes that follow it, and is
+   * scanned with scan and scan_fence_finalize, so each match is reported
+   * exactly once, by the chunk it starts in.  Batches are delivered one
+   * at a time from the sink thread, in no particular order.
+   */
+  class lw_scan_pipeline_t {
+
+    private:
+    const lw_scanner_program_t& scanner_program;
+    const batch_callback_function_t batch_callback;
+    void* const user_data;
+    const size_t worker_count;
+    const size_t chunk_size;
+    const size_t fence_size;
+    const size_t buffer_count;
+
+    // do not allow copy or assignment
+    lw_scan_pipeline_t(const lw_scan_pipeline_t&) = delete;
+    lw_scan_pipeline_t& operator=(const lw_scan_pipeline_t&) = delete;
+
+    public:
+
+    /**
+     * True when the scanner program has been finalized.  The pipeline
+     * will fail if the scanner program has not been finalized.
+     */
+    const bool program_is_finalized;
+
+    /**
+     * Create a scan pipeline.
+     *
+     * Parameters:
+     *   scanner_program - The finalized scanner program.
+     *   batch_callback - The function that receives each buffer's hits,
+     *           called from the sink thread.
+     *   user_data - The user data provided to batch_callback.
+     *   worker_count - The number of scanning threads.
+     *   chunk_size - The size, in bytes, of each chunk to scan.
+     *   fence_size - The maximum number of bytes past the end of a chunk
+     *           to scan for matches that span into the next chunk.
+     *   buffer_count - The number of pooled buffers, which bounds memory
+     *           use and the depth of the queues.
+     */
+    lw_scan_pipeline_t(const lw_scanner_program_t& scanner_program,
+                       batch_callback_function_t batch_callback,
+                       void* user_data,
+                       const size_t worker_count,
+                       const size_t chunk_size,
+                       const size_t fence_size,
+                       const size_t buffer_count);
+
+    /**
+     * Scan a file or block device through the pipeline, starting at
+     * stream offset 0.
+     *
+     * Parameters:
+     *   filename - The file or block device to scan.
+     *
+     * Returns:
+     *   "" if scanned else error text on failure.
+     */
+    std::string scan_file(const std::string& filename);
+
+    /**
+     * Scan an open file descriptor from its current position through the
+     * pipeline, starting at stream offset 0.  The input is read
+     * sequentially so pipes and sockets may be scanned.
+     *
+     * Parameters:
+     *   fd - The open file descriptor to scan.  It is not closed.
+     *
+     * Returns:
+     *   "" if scanned else error text on failure.
+     */
+    std::string scan_fd(const int fd);
+  };
+
+  /**
+   * A streaming scanner that keeps the last lookback_size bytes of the
+   * stream in a ring buffer so that your callback functions can read
+   * match data, including matches that started in earlier pushes, using
+   * read.  Push data of any size; data is scanned directly from your
+   * buffer and the ring buffer storage is reused, so pushes do not
+   * allocate.
+   *
+   * Matches plus the padding before them are fully readable at callback
+   * time when their total size is no larger than lookback_size.  Padding
+   * after a match is limited to the data pushed so far.
+   */
+  class lw_stream_scanner_t {
+
+    private:
+    lw_scanner_t scanner;
+    std::vector<char> ring;
+    uint64_t next_offset;
+    size_t history_size;
+
+    // the data being pushed, readable during its scan
+    const char* push_data;
+    size_t push_size;
+
+    // do not allow copy or assignment
+    lw_stream_scanner_t(const lw_stream_scanner_t&) = delete;
+    lw_stream_scanner_t& operator=(const lw_stream_scanner_t&) = delete;
+
+    // copy stream bytes from the ring buffer
+    void copy_from_ring(uint64_t start, uint64_t end,
+                        std::string& data) const;
+
+    public:
+
+    /**
+     * True when the scanner program has been finalized.  The scanner will
+     * fail if the scanner program has not been finalized.
+     */
+    const bool program_is_finalized;
+
+    /**
+     * Instantiate a streaming scanner.
+     *
+     * Parameters:
+     *   scanner_program - The scanner program containing the regex program
+     *           and the function callbacks that the scanner will use.
+     *   user_data - The user data that this scanner will use.
+     *   lookback_size - The number of bytes of the stream to keep for
+     *           reading match data.  Make this at least the size of your
+     *           largest match plus padding.
+     */
+    lw_stream_scanner_t(const lw_scanner_program_t& scanner_program,
+                        void* user_data,
+                        const size_t lookback_size);
+
+    /**
+     * Scan the next bytes of the stream.
+     *
+     * Parameters:
+     *   data - The bytes to scan.
+     *   size - The number of bytes to scan.
+     */
+    void push(const char* const data, const size_t size);
+
+    /**
+     * End the stream, accepting any active hits that are valid, and
+     * start a new stream at stream offset 0.
+     */
+    void finalize();
+
+    /**
+     * The stream offset of the next byte to be pushed.
+     */
+    uint64_t stream_offset() const;
+
+    /**
+     * Read stream data.  Call this from your callback functions.
+     * Bytes that are no longer in the ring buffer or that have not been
+     * pushed yet are not returned.
+     *
+     * Parameters:
+     *   start - The stream offset of the data to read.
+     *   size - The size, in bytes, of the data to read.
+     *   padding - Padding, in bytes, before and after the data to read,
+     *             or 0 for no padding.
+     *
+     * Returns:
+     *   The data, which may be incomplete if it is not available.
+     */
+    std::string read(const uint64_t start, const uint64_t size,
+                     const size_t padding) const;
+
+    /**
+     * Like read, but copies into data, replacing its contents.  Reuse data
+     * across calls to avoid allocating for each read.
+     */
+    void read_into(const uint64_t start, const uint64_t size,
+                   const size_t padding, std::string& data) const;
+  };
+
+  /**
+   * A scanner that multiplexes many streams over one lightgrep context.
+   * Instead of keeping a context per stream, it keeps the last
+   * lookback_size bytes of each stream in a slab of fixed-size slots.
+   * When scanning switches to another stream, the context is reset and
+   * the stream's saved bytes are replayed into it without reporting
+   * hits, which restores the partial matches that were in progress.
+   *
+   * Lightgrep cannot save a context's state, so replay is used instead.
+   * It is exact when lookback_size is at least the size of the largest
+   * match, and replay costs up to lookback_size bytes of searching per
+   * switch.  Each stream uses lookback_size bytes plus a few words.
+   */
+  class lw_multistream_scanner_t {
+
+    private:
+    // the saved state of a stream
+    struct stream_state_t {
+      uint64_t next_offset;
+      void* user_data;
+      size_t tail_size;
+      bool is_open;
+    };
+
+    lw_scanner_t scanner;
+    const size_t lookback_size;
+    std::vector<stream_state_t> streams;
+    std::vector<char> slab;
+    std::vector<size_t> free_streams;
+    size_t current_stream;
+    size_t open_count;
+
+    // do not allow copy or assignment
+    lw_multistream_scanner_t(const lw_multistream_scanner_t&) = delete;
+    lw_multistream_scanner_t& operator=(
+                               const lw_multistream_scanner_t&) = delete;
+
+    // make stream_id the stream whose state is in the context
+    void switch_to(const size_t stream_id);
+
+    public:
+
+    /**
+     * True when the scanner program has been finalized.  The scanner will
+     * fail if the scanner program has not been finalized.
+     */
+    const bool program_is_finalized;
+
+    /**
+     * Instantiate a multistream scanner.
+     *
+     * Parameters:
+     *   scanner_program - The scanner program containing the regex program
+     *           and the function callbacks that the scanner will use.
+     *   lookback_size - The number of bytes of each stream to keep for
+     *           restoring partial matches.  Make this at least the size
+     *           of your largest match.
+     */
+    lw_multistream_scanner_t(const lw_scanner_program_t& scanner_program,
+                             const size_t lookback_size);
+
+    /**
+     * Start a stream at stream offset 0.
+     *
+     * Parameters:
+     *   user_data - The user data for callbacks of hits in this stream.
+     *
+     * Returns:
+     *   The stream ID, which is reused after the stream is finalized.
+     */
+    size_t open_stream(void* user_data);
+
+    /**
+     * Scan the next bytes of a stream.
+     *
+     * Parameters:
+     *   stream_id - The stream, from open_stream.
+     *   data - The bytes to scan.
+     *   size - The number of bytes to scan.
+     *
+     * Returns:
+     *   "" if scanned else error text on failure.
+     */
+    std::string scan(const size_t stream_id,
+                     const char* const data, const size_t size);
+
+    /**
+     * End a stream, accepting any active hits that are valid, and release
+     * its stream ID.
+     *
+     * Returns:
+     *   "" if finalized else error text on failure.
+     */
+    std::string finalize(const size_t stream_id);
+
+    /**
+     * The stream offset of the next byte of a stream, or 0 if the stream
+     * is not open.
+     */
+    uint64_t stream_offset(const size_t stream_id) const;
+
+    /**
+     * The number of open streams.
+     */
+    size_t stream_count() const;
+  };
+
+  /**
+   * Write hits to a binary hit log without waiting on the disk.  Hits are
+   * serialized into one of two buffers while a background thread writes
+   * the other, so the scanning thread waits only when it fills a buffer
+   * before the previous one has been written.  Read the log back with
+   * lw_hit_log_reader_t.
+   *
+   * Use batch_callback with lw_scanner_t::set_batch_callback to log hits,
+   * or record_callback with lw_scanner_t::set_record_callback to also log
+   * match data and context.  A writer serves one scanning thread; give
+   * each thread its own writer and log.
+   */
+  class lw_hit_log_writer_t {
+
+    private:
+    int fd;
+    size_t buffer_size;
+    std::vector<char> active_buffer;
+    std::vector<char> write_buffer;
+
+    // the background writer and its state
+    std::thread writer_thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool is_writing;
+    bool is_stopping;
+    std::string write_error;
+
+    // do not allow copy or assignment
+    lw_hit_log_writer_t(const lw_hit_log_writer_t&) = delete;
+    lw_hit_log_writer_t& operator=(const lw_hit_log_writer_t&) = delete;
+
+    // the background thread's loop
+    void write_loop();
+
+    // hand the active buffer to the background thread
+    void submit();
+
+    // serialize a hit and its data into the active buffer
+    void append(const lw_hit_t& hit, const uint64_t data_offset,
+                const char* const data, const size_t data_size);
+
+    public:
+
+    /**
+     * Create a writer.  Open a log before writing.
+     */
+    lw_hit_log_writer_t();
+
+    /**
+     * Close the log if it is open.
+     */
+    ~lw_hit_log_writer_t();
+
+    /**
+     * Create or replace a hit log and start the background writer.
+     *
+     * Parameters:
+     *   filename - The hit log file.
+     *   buffer_size - The size, in bytes, of each of the two buffers.
+     *
+     * Returns:
+     *   "" if opened else error text on failure.
+     */
+    std::string open(const std::string& filename, const size_t buffer_size);
+
+    /**
+     * Log a hit without match data.
+     */
+    void write(const lw_hit_t& hit);
+
+    /**
+     * Log a hit with its match data and context.
+     */
+    void write(const lw_hit_record_t& record);
+
+    /**
+     * A batch callback function that logs hits into the writer provided
+     * as user data.
+     */
+    static void batch_callback(const lw_hit_t* hits, const size_t count,
+                               void* p_writer);
+
+    /**
+     * A record callback function that logs hit records into the writer
+     * provided as user data.
+     */
+    static void record_callback(const lw_hit_record_t* records,
+                                const size_t count,
+                                void* p_writer);
+
+    /**
+     * Write any buffered hits, stop the background writer, and close the
+     * log.
+     *
+     * Returns:
+     *   "" if all hits were written else error text on failure.
+     */
+    std::string close();
+  };
+
+  /**
+   * Read a hit log written by lw_hit_log_writer_t.  The log is mapped into
+   * memory and read sequentially.
+   */
+  class lw_hit_log_reader_t {
+
+    private:
+    const char* map;
+    size_t map_size;
+    size_t position;
+
+    // do not allow copy or assignment
+    lw_hit_log_reader_t(const lw_hit_log_reader_t&) = delete;
+    lw_hit_log_reader_t& operator=(const lw_hit_log_reader_t&) = delete;
+
+    public:
+
+    /**
+     * Create a reader.  Open a log before reading.
+     */
+    lw_hit_log_reader_t();
+
+    /**
+     * Close the log if it is open.
+     */
+    ~lw_hit_log_reader_t();
+
+    /**
+     * Open a hit log for reading from its first record.
+     *
+     * Returns:
+     *   "" if opened else error text on failure.
+     */
+    std::string open(const std::string& filename);
+
+    /**
+     * Read the next hit record.  A record that was cut short, as when the
+     * writer did not close the log, ends the log.
+     *
+     * Parameters:
+     *   record - The record, whose data is valid until the reader is
+     *           closed.  Records logged without match data have
+     *           data_size 0.
+     *
+     * Returns:
+     *   True if a record was read, false at the end of the log.
+     */
+    bool next(lw_hit_record_t& record);
+
+    /**
+     * Close the log.
+     */
+    void close();
+  };
+
+  /**
+   * The hits aggregated for one pattern by lw_hit_histogram_t.
+   *
+   * Fields:
+   *   count - The number of hits.
+   *   first_offset - The smallest hit start offset, if count is not 0.
+   *   last_offset - The largest hit start offset, if count is not 0.
+   *   feature_counts - The number of hits for each distinct match data,
+   *           when the histogram is keyed by data.
+   */
+  class lw_pattern_histogram_t {
+    public:
+    uint64_t count;
+    uint64_t first_offset;
+    uint64_t last_offset;
+    std::unordered_map<std::string, uint64_t> feature_counts;
+    lw_pattern_histogram_t();
+  };
+
+  /**
+   * Aggregate hits by pattern index, and optionally by match data, into
+   * a feature histogram.  Give each scanning thread its own histogram as
+   * its scanner's user data, so that no lock is needed, then merge the
+   * histograms when scanning is done.
+   *
+   * Use batch_callback with lw_scanner_t::set_batch_callback to count
+   * hits, or record_callback with lw_scanner_t::set_record_callback to
+   * also count match data.
+   */
+  class lw_hit_histogram_t {
+
+    private:
+    const bool is_keyed_by_data;
+    std::vector<lw_pattern_histogram_t> patterns;
+
+    // count a hit, with its match data if keyed by data
+    void add(const lw_hit_t& hit, const char* const data, const size_t size);
+
+    public:
+
+    /**
+     * Create an empty histogram.
+     *
+     * Parameters:
+     *   is_keyed_by_data - True to also count each distinct match data.
+     */
+    lw_hit_histogram_t(const bool is_keyed_by_data);
+
+    /**
+     * A batch callback function that counts hits into the histogram
+     * provided as user data.  Match data is not available in batches.
+     */
+    static void batch_callback(const lw_hit_t* hits, const size_t count,
+                               void* p_histogram);
+
+    /**
+     * A record callback function that counts hits and their match data
+     * into the histogram provided as user data.
+     */
+    static void record_callback(const lw_hit_record_t* records,
+                                const size_t count,
+                                void* p_histogram);
+
+    /**
+     * Add the counts from other, typically another thread's histogram,
+     * into this histogram.
+     */
+    void merge(const lw_hit_histogram_t& other);
+
+    /**
+     * The number of pattern indices with histogram entries.  Patterns
+     * with larger indices have no hits.
+     */
+    size_t pattern_count() const;
+
+    /**
+     * The hits aggregated for a pattern index.
+     */
+    const lw_pattern_histogram_t& pattern(const size_t pattern_index) const;
+
+    /**
+     * The most frequent match data for a pattern index, most frequent
+     * first, with ties in byte order.
+     *
+     * Parameters:
+     *   pattern_index - The pattern index.
+     *   k - The maximum number of features to return.
+     *
+     * Returns:
+     *   Up to k pairs of match data and count.
+     */
+    std::vector<std::pair<std::string, uint64_t> > top_features(
+                  const size_t pattern_index, const size_t k) const;
+  };
+
+  /**
+   * A hit found by lw_recursive_scanner_t, in the buffer you scanned or
+   * in content decoded from it.
+   *
+   * Fields:
+   *   hit - The scan hit.  Its start is relative to the start of the
+   *           buffer or decoded content that holds it.
+   *   path - The forensic path of the hit, such as "1000-GZIP-37" for a
+   *           hit at offset 37 of content decompressed from gzip data at
+   *           offset 1000 of your buffer, or "37" for a hit in your buffer.
+   *   depth - The number of decodings the hit is inside of, 0 for hits
+   *           in your buffer.
+   *   data - The buffer or decoded content that holds the hit.
+   *   data_size - The size, in bytes, of data.
+   */
+  struct lw_decoded_hit_t {
+    lw_hit_t hit;
+    std::string path;
+    size_t depth;
+    const char* data;
+    size_t data_size;
+  };
+
+  /**
+   * This is the typedef for user-provided decoded hit callback functions
+   * with user data.
+   *
+   * Parameters:
+   *   hits - The hits found by one scan of a buffer or of decoded
+   *           content.  The hits and their data are valid only for the
+   *           duration of the call.
+   *   count - The number of hits.
+   *   user_data - The user data provided to lw_recursive_scanner_t.
+   */
+  typedef void (*decoded_hit_callback_function_t)(
+                                  const lw_decoded_hit_t* hits,
+                                  const size_t count,
+                                  void* user_data);
+
+  /**
+   * A scanner that also scans inside content embedded in your buffer.
+   * After scanning a buffer, it looks for gzip and zlib streams and
+   * base64 text in it, decodes each one into a buffer it keeps for that
+   * depth, and scans and searches the decoded content the same way, down
+   * to max_depth decodings.  Each decoded region is scanned as its own
+   * stream.  Raw deflate data has no signature to detect, so only deflate
+   * data wrapped in gzip or zlib is decoded.  gzip and zlib decoding
+   * require that lightgrep_wrapper was built with zlib.
+   *
+   * The decoded bytes of one scan call are limited to max_decoded_bytes,
+   * so that a decompression bomb costs at most that much memory and
+   * work.  Content decoded past the limit is truncated and not decoded
+   * further.
+   */
+  class lw_recursive_scanner_t {
+
+    private:
+    lw_scanner_t scanner;
+    const decoded_hit_callback_function_t decoded_hit_callback;
+    void* const user_data;
+    const size_t max_depth;
+    const uint64_t max_decoded_bytes;
+    uint64_t decoded_byte_count;
+
+    // the decoded content of each depth, reused across scans
+    std::vector<std::vector<char> > decoded_buffers;
+
+    // the buffer being scanned, for the batch callback
+    const char* current_data;
+    size_t current_data_size;
+    size_t current_depth;
+    std::string current_path;
+    std::vector<lw_decoded_hit_t> decoded_hits;
+
+    // do not allow copy or assignment
+    lw_recursive_scanner_t(const lw_recursive_scanner_t&) = delete;
+    lw_recursive_scanner_t& operator=(const lw_recursive_scanner_t&) = delete;
+
+    // report a batch of hits with the path of the buffer being scanned
+    static void batch_callback(const lw_hit_t* hits, const size_t count,
+                               void* p_recursive_scanner);
+
+    // scan a buffer at a depth, then decode and scan its embedded content
+    void scan_depth(const char* const data, const size_t size,
+                    const size_t depth, const std::string& path);
+
+    // decode the content at data into the buffer for depth + 1, returning
+    // the number of bytes of data used, or 0 if none is decoded
+    size_t decode(const char* const data, const size_t size,
+                  const size_t depth, std::string& type);
+
+    public:
+
+    /**
+     * True when the scanner program has been finalized.  The scanner will
+     * fail if the scanner program has not been finalized.
+     */
+    const bool program_is_finalized;
+
+    /**
+     * Instantiate a recursive scanner.
+     *
+     * Parameters:
+     *   scanner_program - The scanner program containing the regex program.
+     *           Its per-pattern callback functions are not used.
+     *   decoded_hit_callback - The function to call with the hits found.
+     *   user_data - The user data for decoded_hit_callback.
+     *   max_depth - The maximum number of nested decodings, or 0 to scan
+     *           only your buffer.
+     *   max_decoded_bytes - The maximum number of bytes to decode per
+     *           scan call.
+     */
+    lw_recursive_scanner_t(const lw_scanner_program_t& scanner_program,
+                           decoded_hit_callback_function_t decoded_hit_callback,
+                           void* user_data,
+                           const size_t max_depth,
+                           const uint64_t max_decoded_bytes);
+
+    /**
+     * Scan a buffer as one complete stream, then scan the content
+     * embedded in it.
+     *
+     * Parameters:
+     *   buffer - The buffer to scan.
+     *   size - The size, in bytes, of the buffer to scan.
+     */
+    void scan(const char* const buffer, const size_t size);
+
+    /**
+     * The number of bytes decoded by the last scan call.
+     */
+    uint64_t decoded_bytes() const;
+  };
+
+  /**
+   * This convenience function provides a read service for reading
+   * match data in a streaming context.  You provide the buffer
+   * and the previous buffer to read from, the offset to the buffer,
+   * the offset and length of where to read, and any requested
+   * additional padding to read.  The returned data may be smaller
+   * than requested if the span requested is outside the bounds of
+   * the two buffers you provide.
+   *
+   * Two buffers are provided to support stream scanning, where scans
+   * started in one buffer may not be identified until scanning
+   * in the next buffer.  It is your responsibility to provide a large
+   * enough previous buffer in order to read all requested bytes.
+   *
+   * Parameters:
+   *   buffer_offset - The offset to your buffer.
+   *   previous_buffer - The buffer adjacent but before your buffer.
+   *   previous_buffer_size - The size, in bytes, of your previous buffer.
+   *   buffer - The buffer that backs your data being scanned.
+   *   buffer_size - The size, in bytes, of your buffer.
+   *   offset - The offset to the data to read.
    *   length - The length, in bytes, of the data to read.
    *   padding - Padding, in bytes, before and after the data to read,
    *             or 0 for no padding.
@@ -267,6 +2183,71 @@ namespace lw {
                           const size_t offset,
                           const size_t length,
                           const size_t padding);
+
+  /**
+   * A span of bytes in a buffer that you provide.
+   */
+  struct lw_span_t {
+    const char* data;
+    size_t size;
+  };
+
+  /**
+   * The bytes requested from read_buffer_view, which may be split across
+   * your previous buffer and your buffer.  Spans that are not used have
+   * size 0.
+   *
+   * Fields:
+   *   first - The span in previous_buffer.
+   *   second - The span in buffer.
+   */
+  struct buffer_view_t {
+    lw_span_t first;
+    lw_span_t second;
+
+    // the total size, in bytes
+    size_t size() const {
+      return first.size + second.size;
+    }
+  };
+
+  /**
+   * Like read_buffer, but locates the data in your buffers rather than
+   * copying it.  The view is valid as long as your buffers are.
+   *
+   * Parameters:
+   *   See read_buffer.
+   *
+   * Returns:
+   *   A view of the data in your buffers, which may be incomplete if the
+   *   buffers you provide do not sufficiently back the read you request.
+   */
+  buffer_view_t read_buffer_view(const size_t buffer_offset,
+                                 const char* const previous_buffer,
+                                 const size_t previous_buffer_size,
+                                 const char* const buffer,
+                                 const size_t buffer_size,
+                                 const size_t offset,
+                                 const size_t length,
+                                 const size_t padding);
+
+  /**
+   * Like read_buffer, but copies the data into data, replacing its
+   * contents.  Reuse data across calls to avoid allocating for each read.
+   *
+   * Parameters:
+   *   See read_buffer.
+   *   data - The string to copy the data into.
+   */
+  void read_buffer_into(const size_t buffer_offset,
+                        const char* const previous_buffer,
+                        const size_t previous_buffer_size,
+                        const char* const buffer,
+                        const size_t buffer_size,
+                        const size_t offset,
+                        const size_t length,
+                        const size_t padding,
+                        std::string& data);
 }
 
 #endif
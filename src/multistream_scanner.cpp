@@ -0,0 +1,157 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <lightgrep/api.h>
+#include "lightgrep_wrapper.hpp"
+
+// The saved bytes of stream i are kept in slab slot i, at
+// slab[i * lookback_size], oldest first.
+
+namespace lw {
+
+  // there is no current stream
+  static const size_t no_stream = static_cast<size_t>(-1);
+
+  // hits found while replaying were reported before the stream was
+  // suspended
+  static void replay_callback(void*, const LG_SearchHit*) {
+  }
+
+  // constructor
+  lw_multistream_scanner_t::lw_multistream_scanner_t(
+                          const lw_scanner_program_t& scanner_program,
+                          const size_t p_lookback_size) :
+             scanner(scanner_program, nullptr),
+             lookback_size(p_lookback_size == 0 ? 1 : p_lookback_size),
+             streams(),
+             slab(),
+             free_streams(),
+             current_stream(no_stream),
+             open_count(0),
+             program_is_finalized(scanner.program_is_finalized) {
+  }
+
+  // switch_to
+  void lw_multistream_scanner_t::switch_to(const size_t stream_id) {
+    if (stream_id == current_stream) {
+      return;
+    }
+
+    // the current stream's partial matches are restored by replay when
+    // it is resumed, so its context state may be discarded
+    const stream_state_t& stream = streams[stream_id];
+    scanner.reset(stream.user_data);
+    if (stream.tail_size != 0 && scanner.searcher != nullptr) {
+      const char* const tail = &slab[stream_id * lookback_size];
+      lg_search(scanner.searcher,
+                tail,
+                tail + stream.tail_size,
+                stream.next_offset - stream.tail_size,
+                nullptr,
+                replay_callback);
+
+      // the prefilter must not skip data while replayed matches are active
+      scanner.is_search_active = true;
+      scanner.prefilter_live_end = stream.next_offset +
+                                   scanner.prefilter_max_size;
+    }
+    current_stream = stream_id;
+  }
+
+  // open_stream
+  size_t lw_multistream_scanner_t::open_stream(void* user_data) {
+
+    // reuse a slot or add one
+    size_t stream_id;
+    if (!free_streams.empty()) {
+      stream_id = free_streams.back();
+      free_streams.pop_back();
+    } else {
+      stream_id = streams.size();
+      streams.push_back(stream_state_t());
+      slab.resize(streams.size() * lookback_size);
+    }
+
+    stream_state_t& stream = streams[stream_id];
+    stream.next_offset = 0;
+    stream.user_data = user_data;
+    stream.tail_size = 0;
+    stream.is_open = true;
+    ++open_count;
+    return stream_id;
+  }
+
+  // scan
+  std::string lw_multistream_scanner_t::scan(const size_t stream_id,
+                                             const char* const data,
+                                             const size_t size) {
+    if (stream_id >= streams.size() || !streams[stream_id].is_open) {
+      return "Usage error: the stream is not open.";
+    }
+    switch_to(stream_id);
+    stream_state_t& stream = streams[stream_id];
+    scanner.scan(stream.next_offset, data, size);
+    stream.next_offset += size;
+
+    // keep the last lookback_size bytes of the stream
+    char* const tail = &slab[stream_id * lookback_size];
+    if (size >= lookback_size) {
+      std::memcpy(tail, data + size - lookback_size, lookback_size);
+      stream.tail_size = lookback_size;
+    } else {
+      const size_t kept = (stream.tail_size + size > lookback_size) ?
+                                   lookback_size - size : stream.tail_size;
+      std::memmove(tail, tail + stream.tail_size - kept, kept);
+      std::memcpy(tail + kept, data, size);
+      stream.tail_size = kept + size;
+    }
+    return "";
+  }
+
+  // finalize
+  std::string lw_multistream_scanner_t::finalize(const size_t stream_id) {
+    if (stream_id >= streams.size() || !streams[stream_id].is_open) {
+      return "Usage error: the stream is not open.";
+    }
+    switch_to(stream_id);
+    scanner.scan_finalize();
+    current_stream = no_stream;
+    streams[stream_id].is_open = false;
+    free_streams.push_back(stream_id);
+    --open_count;
+    return "";
+  }
+
+  // stream_offset
+  uint64_t lw_multistream_scanner_t::stream_offset(
+                                       const size_t stream_id) const {
+    return (stream_id < streams.size() && streams[stream_id].is_open) ?
+                                      streams[stream_id].next_offset : 0;
+  }
+
+  // stream_count
+  size_t lw_multistream_scanner_t::stream_count() const {
+    return open_count;
+  }
+}
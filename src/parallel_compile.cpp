@@ -0,0 +1,171 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+#include <lightgrep/api.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // the number of regexes parsed per thread before adding them in order
+  static const size_t parse_window_per_thread = 1024;
+
+  // parse regexes in [begin, end) into their pattern handle slots
+  static void parse_regexes(const std::vector<lw_regex_spec_t>* regex_specs,
+                            const size_t begin, const size_t end,
+                            std::vector<LG_HPATTERN>* pattern_handles,
+                            std::vector<std::string>* parse_errors,
+                            std::atomic<size_t>* next_index) {
+    for (size_t i = (*next_index)++; begin + i < end; i = (*next_index)++) {
+      const lw_regex_spec_t& spec = (*regex_specs)[begin + i];
+      (*parse_errors)[i] = parse_regex((*pattern_handles)[i], spec.regex,
+                                       spec.is_case_insensitive,
+                                       spec.is_fixed_string);
+    }
+  }
+
+  // encoding_width
+  unsigned int encoding_width(const std::string& character_encoding) {
+    // multi-byte encodings use several states per character
+    return (character_encoding.find("16") != std::string::npos) ? 2 :
+           (character_encoding.find("32") != std::string::npos) ? 4 : 1;
+  }
+
+  // estimate automaton states from the regex definitions
+  static unsigned int estimate_state_count(
+                      const std::vector<lw_regex_spec_t>& regex_specs) {
+    uint64_t count = 0;
+    for (auto it = regex_specs.begin(); it != regex_specs.end(); ++it) {
+      count += (it->regex.size() + 1) *
+               encoding_width(it->character_encoding);
+    }
+    return (count < (1 << 10)) ? (1 << 10) :
+           (count > (1u << 31)) ? (1u << 31) :
+           static_cast<unsigned int>(count);
+  }
+
+  // add_regexes
+  std::string lw_scanner_program_t::add_regexes(
+                         const std::vector<lw_regex_spec_t>& regex_specs,
+                         const size_t p_thread_count) {
+
+    if (program != nullptr) {
+      return "Usage error: regexes may not be added to a finalized program.";
+    }
+    const size_t thread_count = (p_thread_count == 0) ? 1 : p_thread_count;
+
+    // size the automaton and pattern map from the input rather than
+    // from the constructor's fixed guesses
+    if (function_pointers.empty() && !regex_specs.empty()) {
+      lg_destroy_fsm(fsm);
+      fsm = lg_create_fsm(estimate_state_count(regex_specs));
+      lg_destroy_pattern_map(pattern_map);
+      pattern_map = lg_create_pattern_map(
+                              static_cast<unsigned int>(regex_specs.size()));
+    }
+
+    // one pattern handle per regex in the parse window
+    const size_t window = thread_count * parse_window_per_thread;
+    const size_t slot_count = (regex_specs.size() < window) ?
+                                           regex_specs.size() : window;
+    std::vector<LG_HPATTERN> pattern_handles;
+    for (size_t i = 0; i < slot_count; ++i) {
+      pattern_handles.push_back(lg_create_pattern());
+    }
+    std::vector<std::string> parse_errors(slot_count);
+
+    std::stringstream errors;
+    for (size_t begin = 0; begin < regex_specs.size(); begin += window) {
+      const size_t end = (regex_specs.size() - begin < window) ?
+                         regex_specs.size() : begin + window;
+
+      // parse the window in parallel
+      std::atomic<size_t> next_index(0);
+      std::vector<std::thread> threads;
+      for (size_t i = 1; i < thread_count; ++i) {
+        threads.push_back(std::thread(parse_regexes, &regex_specs, begin,
+                                      end, &pattern_handles, &parse_errors,
+                                      &next_index));
+      }
+      parse_regexes(&regex_specs, begin, end, &pattern_handles,
+                    &parse_errors, &next_index);
+      for (auto it = threads.begin(); it != threads.end(); ++it) {
+        it->join();
+      }
+
+      // add the window in order
+      for (size_t i = begin; i < end; ++i) {
+        const lw_regex_spec_t& spec = regex_specs[i];
+        std::string error = parse_errors[i - begin];
+        if (error == "") {
+          error = add_parsed_regex(pattern_handles[i - begin], spec.regex,
+                                   spec.character_encoding,
+                                   spec.is_case_insensitive,
+                                   spec.is_fixed_string, spec.f,
+                                   static_cast<uint32_t>(
+                                               logical_pattern_count()));
+        }
+        if (error != "") {
+          errors << error << "\n";
+        }
+      }
+    }
+
+    for (auto it = pattern_handles.begin(); it != pattern_handles.end();
+                                                                  ++it) {
+      lg_destroy_pattern(*it);
+    }
+    return errors.str();
+  }
+
+  // finalize programs until no programs remain
+  static void finalize_some_programs(
+                 const std::vector<lw_scanner_program_t*>* scanner_programs,
+                 const bool is_determinized,
+                 std::atomic<size_t>* next_index) {
+    for (size_t i = (*next_index)++; i < scanner_programs->size();
+                                     i = (*next_index)++) {
+      (*scanner_programs)[i]->finalize_program(is_determinized);
+    }
+  }
+
+  // finalize_programs
+  void lw_scanner_program_t::finalize_programs(
+                 const std::vector<lw_scanner_program_t*>& scanner_programs,
+                 const bool is_determinized,
+                 const size_t thread_count) {
+    std::atomic<size_t> next_index(0);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count && i < scanner_programs.size(); ++i) {
+      threads.push_back(std::thread(finalize_some_programs,
+                                    &scanner_programs, is_determinized,
+                                    &next_index));
+    }
+    finalize_some_programs(&scanner_programs, is_determinized, &next_index);
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+      it->join();
+    }
+  }
+}
@@ -0,0 +1,433 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sched.h>
+#include <pthread.h>
+#include <lightgrep/api.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // parse a Linux CPU list such as "0-3,8-11"
+  static std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    std::stringstream ss(text);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+      const size_t dash = range.find('-');
+      const int first = std::atoi(range.c_str());
+      const int last = (dash == std::string::npos) ?
+                       first : std::atoi(range.c_str() + dash + 1);
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    return cpus;
+  }
+
+  // the CPUs of each NUMA node that this process may run on, in node
+  // order, or none if the nodes are not known
+  static std::vector<std::vector<int> > find_node_cpus() {
+    std::vector<std::vector<int> > node_cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (::sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+      return node_cpus;
+    }
+
+    // find the node numbers
+    const std::string node_path = "/sys/devices/system/node/";
+    DIR* dir = ::opendir(node_path.c_str());
+    if (dir == nullptr) {
+      return node_cpus;
+    }
+    std::vector<int> nodes;
+    for (struct dirent* entry = ::readdir(dir); entry != nullptr;
+                                                entry = ::readdir(dir)) {
+      const std::string name(entry->d_name);
+      if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+          name.find_first_not_of("0123456789", 4) == std::string::npos) {
+        nodes.push_back(std::atoi(name.c_str() + 4));
+      }
+    }
+    ::closedir(dir);
+    std::sort(nodes.begin(), nodes.end());
+
+    // keep the nodes with CPUs that this process may run on
+    for (auto it = nodes.begin(); it != nodes.end(); ++it) {
+      std::ifstream in(node_path + "node" + std::to_string(*it) + "/cpulist");
+      std::string text;
+      std::getline(in, text);
+      const std::vector<int> cpus = parse_cpu_list(text);
+      std::vector<int> usable_cpus;
+      for (auto cpu = cpus.begin(); cpu != cpus.end(); ++cpu) {
+        if (*cpu >= 0 && *cpu < CPU_SETSIZE && CPU_ISSET(*cpu, &allowed)) {
+          usable_cpus.push_back(*cpu);
+        }
+      }
+      if (!usable_cpus.empty()) {
+        node_cpus.push_back(usable_cpus);
+      }
+    }
+    return node_cpus;
+  }
+
+  // run the calling thread on the given CPUs, if any
+  static void pin_thread(const std::vector<int>* cpus) {
+    if (cpus == nullptr) {
+      return;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (auto it = cpus->begin(); it != cpus->end(); ++it) {
+      CPU_SET(*it, &cpu_set);
+    }
+    // scanning still works, though not node-local, if this fails
+    ::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set);
+  }
+
+  // run the calling thread on the given CPUs, if any, until destroyed
+  class scoped_pin_t {
+    private:
+    cpu_set_t saved;
+    bool is_saved;
+
+    public:
+    scoped_pin_t(const std::vector<int>* cpus) : saved(), is_saved(false) {
+      if (cpus != nullptr) {
+        is_saved = ::pthread_getaffinity_np(::pthread_self(), sizeof(saved),
+                                            &saved) == 0;
+        pin_thread(cpus);
+      }
+    }
+    ~scoped_pin_t() {
+      if (is_saved) {
+        ::pthread_setaffinity_np(::pthread_self(), sizeof(saved), &saved);
+      }
+    }
+  };
+
+  // scan buffer chunks until no chunks remain
+  static void scan_buffer_chunks(const std::vector<int>* cpus,
+                                 lw_scanner_t* scanner,
+                                 const size_t chunk_size,
+                                 const uint64_t stream_offset,
+                                 const char* const buffer,
+                                 const size_t size,
+                                 std::atomic<size_t>* next_chunk_index) {
+
+    pin_thread(cpus);
+    const size_t chunk_count = (size + chunk_size - 1) / chunk_size;
+    for (size_t i = (*next_chunk_index)++; i < chunk_count;
+                                           i = (*next_chunk_index)++) {
+      const size_t start = i * chunk_size;
+      const size_t count = (size - start < chunk_size) ?
+                                         size - start : chunk_size;
+
+      // scan the chunk
+      scanner->scan(stream_offset + start, buffer + start, count);
+
+      // resolve matches that started in the chunk using the rest of
+      // the buffer
+      scanner->scan_fence_finalize(stream_offset + start + count,
+                                   buffer + start + count,
+                                   size - start - count);
+    }
+  }
+
+  // read count bytes at offset, returning bytes read or -1 on error
+  static ssize_t read_fully(const int fd, char* const buffer,
+                            const size_t count, const uint64_t offset) {
+    size_t total = 0;
+    while (total < count) {
+      const ssize_t status = ::pread(fd, buffer + total, count - total,
+                                     static_cast<off_t>(offset + total));
+      if (status < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return -1;
+      }
+      if (status == 0) {
+        // EOF
+        break;
+      }
+      total += static_cast<size_t>(status);
+    }
+    return static_cast<ssize_t>(total);
+  }
+
+  // scan file chunks until no chunks remain
+  static void scan_file_chunks(const std::vector<int>* cpus,
+                               lw_scanner_t* scanner,
+                               const size_t chunk_size,
+                               const size_t fence_size,
+                               const int fd,
+                               const uint64_t file_size,
+                               std::atomic<size_t>* next_chunk_index,
+                               std::mutex* error_mutex,
+                               std::string* error) {
+
+    // pin before allocating so that the buffer is in the node's memory
+    pin_thread(cpus);
+    const uint64_t chunk_count = (file_size + chunk_size - 1) / chunk_size;
+    std::vector<char> buffer(chunk_size + fence_size);
+    for (uint64_t i = (*next_chunk_index)++; i < chunk_count;
+                                             i = (*next_chunk_index)++) {
+      const uint64_t start = i * chunk_size;
+      const ssize_t count = read_fully(fd, buffer.data(), buffer.size(),
+                                       start);
+      if (count < 0) {
+        std::lock_guard<std::mutex> lock(*error_mutex);
+        if (error->empty()) {
+          std::stringstream ss;
+          ss << "Read error at offset " << start << ": "
+             << std::strerror(errno);
+          *error = ss.str();
+        }
+        return;
+      }
+      const size_t chunk_count_bytes =
+                     (static_cast<size_t>(count) < chunk_size) ?
+                     static_cast<size_t>(count) : chunk_size;
+
+      // scan the chunk then resolve matches using the fence bytes
+      scanner->scan(start, buffer.data(), chunk_count_bytes);
+      scanner->scan_fence_finalize(start + chunk_count_bytes,
+                                   buffer.data() + chunk_count_bytes,
+                                   static_cast<size_t>(count) -
+                                   chunk_count_bytes);
+    }
+  }
+
+  // constructor
+  lw_parallel_scanner_t::lw_parallel_scanner_t(
+                          const lw_scanner_program_t& scanner_program,
+                          const std::vector<void*>& user_data,
+                          const size_t p_chunk_size,
+                          const size_t p_fence_size,
+                          const bool is_numa_local) :
+             chunk_size(p_chunk_size == 0 ? 1 : p_chunk_size),
+             fence_size(p_fence_size),
+             scanners(),
+             node_programs(),
+             node_cpus(),
+             scanner_nodes(),
+             program_is_finalized(scanner_program.program != nullptr) {
+
+    if (is_numa_local && program_is_finalized && !user_data.empty()) {
+      node_cpus = find_node_cpus();
+    }
+
+    // share the program
+    if (node_cpus.empty()) {
+      for (auto it = user_data.begin(); it != user_data.end(); ++it) {
+        scanners.push_back(new lw_scanner_t(scanner_program, *it));
+      }
+      return;
+    }
+
+    // assign threads to nodes in turn, using only nodes with threads
+    if (node_cpus.size() > user_data.size()) {
+      node_cpus.resize(user_data.size());
+    }
+    for (size_t i = 0; i < user_data.size(); ++i) {
+      scanner_nodes.push_back(i % node_cpus.size());
+    }
+
+    // copy the program and create the scanners on each node
+    std::vector<char> program_bytes(static_cast<size_t>(
+                             lg_program_size(scanner_program.program)));
+    lg_write_program(scanner_program.program, program_bytes.data());
+    node_programs.resize(node_cpus.size(), nullptr);
+    scanners.resize(user_data.size(), nullptr);
+    std::vector<std::thread> threads;
+    for (size_t node = 0; node < node_cpus.size(); ++node) {
+      threads.push_back(std::thread(&lw_parallel_scanner_t::build_node,
+                                    this, node, &scanner_program,
+                                    &program_bytes, &user_data));
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+      it->join();
+    }
+  }
+
+  // build_node
+  void lw_parallel_scanner_t::build_node(
+                          const size_t node,
+                          const lw_scanner_program_t* scanner_program,
+                          const std::vector<char>* program_bytes,
+                          const std::vector<void*>* user_data) {
+    pin_thread(&node_cpus[node]);
+
+    // memory is placed on the node of the thread that first touches it
+    LG_HPROGRAM program = lg_read_program(
+                       const_cast<char*>(program_bytes->data()),
+                       static_cast<int>(program_bytes->size()));
+    const lw_scanner_program_t* node_program = scanner_program;
+    if (program != nullptr) {
+      lw_scanner_program_t* copy = new lw_scanner_program_t;
+
+      // the copy is finalized so discard its parsing resources
+      lg_destroy_pattern(copy->pattern_handle);
+      copy->pattern_handle = nullptr;
+      lg_destroy_fsm(copy->fsm);
+      copy->fsm = nullptr;
+      copy->program = program;
+      copy->function_pointers = scanner_program->function_pointers;
+      copy->logical_indices = scanner_program->logical_indices;
+      copy->pattern_encodings = scanner_program->pattern_encodings;
+      copy->pattern_function_pointers =
+                          scanner_program->pattern_function_pointers;
+      copy->pattern_set_hash = scanner_program->pattern_set_hash;
+      copy->prefilter_bytes = scanner_program->prefilter_bytes;
+      copy->prefilter_max_size = scanner_program->prefilter_max_size;
+      copy->is_prefilterable = scanner_program->is_prefilterable;
+      node_programs[node] = copy;
+      node_program = copy;
+    }
+
+    // the scanners' contexts are placed on the node too
+    for (size_t i = 0; i < user_data->size(); ++i) {
+      if (scanner_nodes[i] == node) {
+        scanners[i] = new lw_scanner_t(*node_program, (*user_data)[i]);
+      }
+    }
+  }
+
+  // destructor
+  lw_parallel_scanner_t::~lw_parallel_scanner_t() {
+    for (auto it = scanners.begin(); it != scanners.end(); ++it) {
+      delete *it;
+    }
+    for (auto it = node_programs.begin(); it != node_programs.end(); ++it) {
+      delete *it;
+    }
+  }
+
+  // scanner_cpus
+  const std::vector<int>* lw_parallel_scanner_t::scanner_cpus(
+                                                const size_t i) const {
+    return node_cpus.empty() ? nullptr : &node_cpus[scanner_nodes[i]];
+  }
+
+  // numa_node_count
+  size_t lw_parallel_scanner_t::numa_node_count() const {
+    return node_cpus.size();
+  }
+
+  // scan
+  void lw_parallel_scanner_t::scan(uint64_t stream_offset,
+                                   const char* const buffer, size_t size) {
+
+    if (!program_is_finalized || scanners.empty() || size == 0) {
+      return;
+    }
+
+    std::atomic<size_t> next_chunk_index(0);
+
+    // start threads for all but the first scanner
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < scanners.size(); ++i) {
+      threads.push_back(std::thread(scan_buffer_chunks, scanner_cpus(i),
+                                    scanners[i], chunk_size, stream_offset,
+                                    buffer, size, &next_chunk_index));
+    }
+
+    // the calling thread uses the first scanner
+    scoped_pin_t pin(scanner_cpus(0));
+    scan_buffer_chunks(nullptr, scanners[0], chunk_size, stream_offset,
+                       buffer, size, &next_chunk_index);
+
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+      it->join();
+    }
+  }
+
+  // scan_file
+  std::string lw_parallel_scanner_t::scan_file(const std::string& filename) {
+
+    if (!program_is_finalized || scanners.empty()) {
+      return "Usage error: the scanner program must be finalized and "
+             "at least one thread must be requested.";
+    }
+
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::stringstream ss;
+      ss << "Unable to open file '" << filename << "': "
+         << std::strerror(errno);
+      return ss.str();
+    }
+
+    // lseek works for both files and block devices
+    const off_t end = ::lseek(fd, 0, SEEK_END);
+    if (end < 0) {
+      std::stringstream ss;
+      ss << "Unable to size file '" << filename << "': "
+         << std::strerror(errno);
+      ::close(fd);
+      return ss.str();
+    }
+    const uint64_t file_size = static_cast<uint64_t>(end);
+
+    std::atomic<size_t> next_chunk_index(0);
+    std::mutex error_mutex;
+    std::string error;
+
+    // start threads for all but the first scanner
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < scanners.size(); ++i) {
+      threads.push_back(std::thread(scan_file_chunks, scanner_cpus(i),
+                                    scanners[i], chunk_size, fence_size, fd,
+                                    file_size, &next_chunk_index,
+                                    &error_mutex, &error));
+    }
+
+    // the calling thread uses the first scanner
+    {
+      scoped_pin_t pin(scanner_cpus(0));
+      scan_file_chunks(nullptr, scanners[0], chunk_size, fence_size, fd,
+                       file_size, &next_chunk_index, &error_mutex, &error);
+    }
+
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+      it->join();
+    }
+
+    ::close(fd);
+    return error;
+  }
+}
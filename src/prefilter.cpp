@@ -0,0 +1,207 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <stdint.h>
+#include <lightgrep/api.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // skip runs of at least this many bytes that no pattern can start in,
+  // since closing out and restarting the search has a cost
+  static const size_t prefilter_min_gap = 512;
+
+  // keep the prefilter only when fewer bytes than this can start a match
+  static const size_t prefilter_max_first_bytes = 128;
+
+  // true if regex has no characters that are special to the regex parser
+  static bool is_literal_regex(const std::string& regex) {
+    return regex.find_first_of("\\.[]()*+?{}|^$") == std::string::npos;
+  }
+
+  // the non-ASCII character that Unicode case folding matches with an
+  // ASCII letter, U+212A KELVIN SIGN for k and U+017F LATIN SMALL LETTER
+  // LONG S for s, or 0 if there is none
+  static uint32_t non_ascii_fold(const unsigned char c) {
+    switch (std::tolower(c)) {
+      case 'k': return 0x212A;
+      case 's': return 0x017F;
+      default: return 0;
+    }
+  }
+
+  // update_prefilter
+  void lw_scanner_program_t::update_prefilter(const std::string& regex,
+                              const std::string& character_encoding,
+                              const bool is_case_insensitive,
+                              const bool is_fixed_string) {
+    if (!is_prefilterable) {
+      return;
+    }
+
+    // the pattern must be a literal whose first character is ASCII, and
+    // case insensitive patterns must be all ASCII so that their byte size
+    // is known
+    bool is_ascii = true;
+    for (auto it = regex.begin(); it != regex.end(); ++it) {
+      is_ascii = is_ascii && (static_cast<unsigned char>(*it) < 0x80);
+    }
+    const bool is_utf16le = (character_encoding == "UTF-16LE");
+    const bool is_utf16be = (character_encoding == "UTF-16BE");
+    const bool is_utf8 = (character_encoding == "UTF-8" ||
+                          character_encoding == "ASCII");
+    if (regex.empty() || (!is_fixed_string && !is_literal_regex(regex)) ||
+        static_cast<unsigned char>(regex[0]) >= 0x80 ||
+        (is_case_insensitive && !is_ascii) ||
+        (!is_utf8 && !is_utf16le && !is_utf16be)) {
+      is_prefilterable = false;
+      prefilter_bytes.clear();
+      return;
+    }
+
+    // case insensitive UTF-8 and UTF-16 patterns also match the
+    // non-ASCII case folds of their letters
+    const bool is_folded = is_case_insensitive &&
+                           character_encoding != "ASCII";
+
+    // record the bytes the pattern can start with
+    const unsigned char c = static_cast<unsigned char>(regex[0]);
+    if (is_utf16be) {
+      prefilter_bytes[0] = 1;
+    } else {
+      prefilter_bytes[c] = 1;
+      if (is_case_insensitive) {
+        prefilter_bytes[std::tolower(c)] = 1;
+        prefilter_bytes[std::toupper(c)] = 1;
+      }
+    }
+    const uint32_t fold = is_folded ? non_ascii_fold(c) : 0;
+    if (fold != 0) {
+      if (is_utf16le) {
+        prefilter_bytes[fold & 0xff] = 1;
+      } else if (is_utf16be) {
+        prefilter_bytes[fold >> 8] = 1;
+      } else {
+        prefilter_bytes[(fold < 0x800) ? 0xc0 | (fold >> 6) :
+                                         0xe0 | (fold >> 12)] = 1;
+      }
+    }
+
+    // a UTF-8 byte is at most one UTF-16 code unit, and a folded letter
+    // is at most three UTF-8 bytes
+    size_t size = is_utf8 ? regex.size() : 2 * regex.size();
+    if (is_utf8 && is_folded) {
+      for (auto it = regex.begin(); it != regex.end(); ++it) {
+        const uint32_t letter_fold =
+                         non_ascii_fold(static_cast<unsigned char>(*it));
+        size += (letter_fold == 0) ? 0 : (letter_fold < 0x800) ? 1 : 2;
+      }
+    }
+    if (size > prefilter_max_size) {
+      prefilter_max_size = size;
+    }
+  }
+
+  // finish_prefilter
+  void lw_scanner_program_t::finish_prefilter() {
+    size_t count = 0;
+    for (auto it = prefilter_bytes.begin(); it != prefilter_bytes.end();
+         ++it) {
+      count += *it;
+    }
+    if (count == 0 || count >= prefilter_max_first_bytes) {
+      is_prefilterable = false;
+      prefilter_bytes.clear();
+    }
+  }
+
+  // is_prefiltered
+  bool lw_scanner_program_t::is_prefiltered() const {
+    return program != nullptr && !prefilter_bytes.empty();
+  }
+
+  // search_prefiltered
+  void lw_scanner_t::search_prefiltered(const uint64_t stream_offset,
+                                        const char* const buffer,
+                                        const size_t size) {
+
+    const unsigned char* const bytes =
+                         reinterpret_cast<const unsigned char*>(buffer);
+    size_t search_start = 0;
+    size_t i = 0;
+    while (i < size) {
+
+      // a match may start here or be in progress
+      if (prefilter_bytes[bytes[i]]) {
+        prefilter_live_end = stream_offset + i + prefilter_max_size;
+        ++i;
+        continue;
+      }
+      if (stream_offset + i < prefilter_live_end) {
+        ++i;
+        continue;
+      }
+
+      // no match can start or be in progress until the next first byte
+      size_t next = i + 1;
+      while (next < size && !prefilter_bytes[bytes[next]]) {
+        ++next;
+      }
+      if (next - i < prefilter_min_gap) {
+        i = next;
+        continue;
+      }
+
+      // search up to the gap, close out the search, and skip the gap
+      if (i > search_start) {
+        lg_search(searcher,
+                  buffer + search_start,
+                  buffer + i,
+                  stream_offset + search_start,
+                  hit_callback_data,
+                  hit_callback);
+        is_search_active = true;
+      }
+      if (is_search_active) {
+        lg_closeout_search(searcher,
+                           hit_callback_data,
+                           hit_callback);
+        lg_reset_context(searcher);
+        is_search_active = false;
+      }
+      search_start = next;
+      i = next;
+    }
+
+    // search the rest
+    if (size > search_start) {
+      lg_search(searcher,
+                buffer + search_start,
+                buffer + size,
+                stream_offset + search_start,
+                hit_callback_data,
+                hit_callback);
+      is_search_active = true;
+    }
+  }
+}
@@ -0,0 +1,279 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+// Saved program file layout, in native byte order:
+//   char[8]  magic
+//   uint64_t pattern set hash
+//   uint64_t pattern count
+//   uint64_t program size
+//   program bytes written by lg_write_program
+
+#include <config.h>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <lightgrep/api.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  static const char program_file_magic[8] = {'L','W','P','R','O','G','0','2'};
+
+  // the header is followed by the logical index of each pattern index
+  // then the program
+  struct program_file_header_t {
+    char magic[8];
+    uint64_t pattern_set_hash;
+    uint64_t pattern_count;
+    uint64_t program_size;
+  };
+
+  // FNV-1a over bytes
+  static uint64_t hash_bytes(uint64_t hash, const char* const bytes,
+                             const size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= static_cast<unsigned char>(bytes[i]);
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  // hash a string with its length so adjacent strings do not run together
+  static uint64_t hash_string(uint64_t hash, const std::string& text) {
+    const uint64_t size = text.size();
+    hash = hash_bytes(hash, reinterpret_cast<const char*>(&size),
+                      sizeof(size));
+    return hash_bytes(hash, text.c_str(), text.size());
+  }
+
+  // hash_regex
+  uint64_t hash_regex(uint64_t hash,
+                      const std::string& regex,
+                      const std::string& character_encoding,
+                      const bool is_case_insensitive,
+                      const bool is_fixed_string) {
+    const char flags[2] = {is_case_insensitive ? '1' : '0',
+                           is_fixed_string ? '1' : '0'};
+    hash = hash_string(hash, regex);
+    hash = hash_string(hash, character_encoding);
+    return hash_bytes(hash, flags, sizeof(flags));
+  }
+
+  static std::string compose_cache_error(const std::string& text,
+                                         const std::string& filename) {
+    std::stringstream ss;
+    ss << text << " '" << filename << "'";
+    if (errno != 0) {
+      ss << ": " << std::strerror(errno);
+    }
+    return ss.str();
+  }
+
+  // write all bytes
+  static bool write_fully(const int fd, const char* buffer, size_t count) {
+    while (count > 0) {
+      const ssize_t status = ::write(fd, buffer, count);
+      if (status < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      buffer += status;
+      count -= static_cast<size_t>(status);
+    }
+    return true;
+  }
+
+  // save
+  std::string lw_scanner_program_t::save(const std::string& filename) const {
+
+    errno = 0;
+    if (program == nullptr) {
+      return "Usage error: the scanner program must be finalized before "
+             "it can be saved.";
+    }
+
+    // serialize the program
+    const int program_size = lg_program_size(program);
+    if (program_size <= 0) {
+      return compose_cache_error("Unable to serialize program for", filename);
+    }
+    const size_t table_size = logical_indices.size() * sizeof(uint32_t);
+    std::vector<char> bytes(sizeof(program_file_header_t) + table_size +
+                            program_size);
+    program_file_header_t header;
+    std::memcpy(header.magic, program_file_magic, sizeof(header.magic));
+    header.pattern_set_hash = pattern_set_hash;
+    header.pattern_count = logical_indices.size();
+    header.program_size = static_cast<uint64_t>(program_size);
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    if (table_size > 0) {
+      std::memcpy(bytes.data() + sizeof(header), logical_indices.data(),
+                  table_size);
+    }
+    lg_write_program(program, bytes.data() + sizeof(header) + table_size);
+
+    // write to a uniquely named temporary file in the same directory then
+    // rename it into place so concurrent readers never see a partial file
+    // and concurrent writers do not collide
+    std::vector<char> temp_name(filename.begin(), filename.end());
+    const char temp_suffix[] = ".XXXXXX";
+    temp_name.insert(temp_name.end(), temp_suffix,
+                     temp_suffix + sizeof(temp_suffix));
+    const int fd = ::mkstemp(temp_name.data());
+    const std::string temp_filename(temp_name.data());
+    if (fd < 0) {
+      return compose_cache_error("Unable to create", temp_filename);
+    }
+    const bool is_written = write_fully(fd, bytes.data(), bytes.size());
+    if (::close(fd) != 0 || !is_written) {
+      const std::string error = compose_cache_error("Unable to write",
+                                                    temp_filename);
+      ::unlink(temp_filename.c_str());
+      return error;
+    }
+    if (::rename(temp_filename.c_str(), filename.c_str()) != 0) {
+      const std::string error = compose_cache_error("Unable to rename to",
+                                                    filename);
+      ::unlink(temp_filename.c_str());
+      return error;
+    }
+    return "";
+  }
+
+  // load
+  std::string lw_scanner_program_t::load(const std::string& filename,
+                       const std::vector<lw_regex_spec_t>& regex_specs,
+                       const bool is_determinized) {
+
+    errno = 0;
+    if (program != nullptr || !function_pointers.empty()) {
+      return "Usage error: a program may only be loaded into an empty "
+             "scanner program.";
+    }
+
+    // hash the requested definitions the way add_regex and
+    // finalize_program do
+    uint64_t hash = pattern_set_hash;
+    for (auto it = regex_specs.begin(); it != regex_specs.end(); ++it) {
+      hash = hash_regex(hash, it->regex, it->character_encoding,
+                        it->is_case_insensitive, it->is_fixed_string);
+    }
+    hash = hash_regex(hash, "", "", is_determinized, false);
+
+    // map the file
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return compose_cache_error("Unable to open", filename);
+    }
+    const off_t end = ::lseek(fd, 0, SEEK_END);
+    if (end < static_cast<off_t>(sizeof(program_file_header_t))) {
+      ::close(fd);
+      errno = 0;
+      return compose_cache_error("Invalid program file", filename);
+    }
+    void* const map = ::mmap(nullptr, static_cast<size_t>(end), PROT_READ,
+                             MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+      return compose_cache_error("Unable to map", filename);
+    }
+
+    // validate the header and the logical index table
+    errno = 0;
+    program_file_header_t header;
+    std::memcpy(&header, map, sizeof(header));
+    char* const table = static_cast<char*>(map) + sizeof(header);
+    const uint64_t table_size = header.pattern_count * sizeof(uint32_t);
+    std::vector<uint32_t> loaded_logical_indices;
+    std::string error;
+    if (std::memcmp(header.magic, program_file_magic,
+                    sizeof(header.magic)) != 0 ||
+        header.pattern_count > static_cast<uint64_t>(end) ||
+        table_size > static_cast<uint64_t>(end) - sizeof(header) ||
+        header.program_size !=
+                 static_cast<uint64_t>(end) - sizeof(header) - table_size) {
+      error = compose_cache_error("Invalid program file", filename);
+    } else if (header.pattern_set_hash != hash ||
+               header.pattern_count != regex_specs.size()) {
+      error = compose_cache_error(
+                      "Regex definitions do not match program file", filename);
+    } else {
+
+      // logical indices start at 0 and step by at most 1
+      loaded_logical_indices.resize(regex_specs.size());
+      if (table_size > 0) {
+        std::memcpy(loaded_logical_indices.data(), table, table_size);
+      }
+      uint32_t next_logical_index = 0;
+      for (auto it = loaded_logical_indices.begin();
+           it != loaded_logical_indices.end(); ++it) {
+        if (*it == next_logical_index) {
+          ++next_logical_index;
+        } else if (*it + 1 != next_logical_index) {
+          error = compose_cache_error("Invalid program file", filename);
+          break;
+        }
+      }
+    }
+    if (error == "") {
+
+      // read the program
+      LG_HPROGRAM loaded_program = lg_read_program(
+                      table + table_size,
+                      static_cast<int>(header.program_size));
+      if (loaded_program == nullptr) {
+        error = compose_cache_error("Unable to read program from", filename);
+      } else {
+
+        // the program is finalized so discard the parsing resources
+        lg_destroy_pattern(pattern_handle);
+        pattern_handle = nullptr;
+        lg_destroy_fsm(fsm);
+        fsm = nullptr;
+        program = loaded_program;
+        pattern_set_hash = hash;
+        logical_indices = loaded_logical_indices;
+        for (size_t i = 0; i < regex_specs.size(); ++i) {
+          if (function_pointers.size() == logical_indices[i]) {
+            function_pointers.push_back(regex_specs[i].f);
+          }
+          pattern_encodings.push_back(regex_specs[i].character_encoding);
+        }
+        for (auto it = regex_specs.begin(); it != regex_specs.end(); ++it) {
+          update_prefilter(it->regex, it->character_encoding,
+                           it->is_case_insensitive, it->is_fixed_string);
+        }
+        finish_prefilter();
+        finish_function_pointers();
+      }
+    }
+
+    ::munmap(map, static_cast<size_t>(end));
+    return error;
+  }
+}
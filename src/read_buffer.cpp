@@ -19,26 +19,27 @@
 
 #include <config.h>
 #include <string>
-#include <sstream>
 #include <stdint.h>
 #include <iostream>
-#include <cassert>
+#include "lightgrep_wrapper.hpp"
 
 namespace lw {
 
   /*
-   * Read bytes from buffer, possibly reading from previous_buffer.
+   * Locate bytes in buffer, possibly in previous_buffer.
    * Bytes that fall outside the bounds of the two buffers provided are
-   * not returned.
+   * not included.
    */
-  std::string read_buffer(const size_t buffer_offset,
-                          const char* const previous_buffer,
-                          const size_t previous_buffer_size,
-                          const char* const buffer,
-                          const size_t buffer_size,
-                          const size_t offset,
-                          const size_t length,
-                          const size_t padding) {
+  buffer_view_t read_buffer_view(const size_t buffer_offset,
+                                 const char* const previous_buffer,
+                                 const size_t previous_buffer_size,
+                                 const char* const buffer,
+                                 const size_t buffer_size,
+                                 const size_t offset,
+                                 const size_t length,
+                                 const size_t padding) {
+
+    buffer_view_t view = {{nullptr, 0}, {nullptr, 0}};
 
     // check for invalid input
     if (buffer_offset < previous_buffer_size) {
@@ -46,7 +47,7 @@ namespace lw {
                 << "buffer_offset: " << buffer_offset
                 << ", previous_buffer_size: " << previous_buffer_size
                 << std::endl;
-      return "";
+      return view;
     }
 
     // start offset of the previous buffer
@@ -61,8 +62,6 @@ namespace lw {
     // requested end offset, one byte after end
     size_t end_offset = offset + length + padding;
 
-    // build the return string
-    std::stringstream ss;
     size_t start;
     size_t end;
 
@@ -72,8 +71,8 @@ namespace lw {
                ? previous_buffer_offset : start_offset;
       end = (end_offset > buffer_offset) ? buffer_offset : end_offset;
       if (start < end) {
-        ss << std::string(&previous_buffer[start - previous_buffer_offset],
-                          end - start);
+        view.first.data = &previous_buffer[start - previous_buffer_offset];
+        view.first.size = end - start;
       }
     }
 
@@ -83,11 +82,56 @@ namespace lw {
       end = (end_offset > buffer_offset + buffer_size)
              ? buffer_offset + buffer_size : end_offset;
       if (start < end) {
-        ss << std::string(&buffer[start - buffer_offset], end - start);
+        view.second.data = &buffer[start - buffer_offset];
+        view.second.size = end - start;
       }
     }
 
-    return ss.str();
+    return view;
   }
-}
 
+  /*
+   * Read bytes from buffer into data, reusing the storage in data.
+   */
+  void read_buffer_into(const size_t buffer_offset,
+                        const char* const previous_buffer,
+                        const size_t previous_buffer_size,
+                        const char* const buffer,
+                        const size_t buffer_size,
+                        const size_t offset,
+                        const size_t length,
+                        const size_t padding,
+                        std::string& data) {
+
+    const buffer_view_t view = read_buffer_view(buffer_offset,
+                             previous_buffer, previous_buffer_size,
+                             buffer, buffer_size, offset, length, padding);
+    data.clear();
+    if (view.first.size != 0) {
+      data.append(view.first.data, view.first.size);
+    }
+    if (view.second.size != 0) {
+      data.append(view.second.data, view.second.size);
+    }
+  }
+
+  /*
+   * Read bytes from buffer, possibly reading from previous_buffer.
+   * Bytes that fall outside the bounds of the two buffers provided are
+   * not returned.
+   */
+  std::string read_buffer(const size_t buffer_offset,
+                          const char* const previous_buffer,
+                          const size_t previous_buffer_size,
+                          const char* const buffer,
+                          const size_t buffer_size,
+                          const size_t offset,
+                          const size_t length,
+                          const size_t padding) {
+
+    std::string data;
+    read_buffer_into(buffer_offset, previous_buffer, previous_buffer_size,
+                     buffer, buffer_size, offset, length, padding, data);
+    return data;
+  }
+}
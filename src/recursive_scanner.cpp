@@ -0,0 +1,273 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <stdint.h>
+#include "lightgrep_wrapper.hpp"
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+#include <zlib.h>
+#endif
+
+// The content decoded at depth d + 1 is kept in decoded_buffers[d], so
+// the content of every depth being searched stays valid while the
+// content embedded in it is decoded and scanned.
+
+namespace lw {
+
+  // the smallest run of base64 characters that is decoded
+  static const size_t min_base64_size = 64;
+
+  // inflate output is grown by this much at a time
+  static const size_t inflate_chunk_size = 1 << 16;
+
+  // the value of a base64 character, or -1 if it is not one
+  static int base64_value(const unsigned char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+  }
+
+  // the size of the run of base64 characters and line breaks at data
+  static size_t base64_run_size(const char* const data, const size_t size,
+                                size_t& character_count) {
+    character_count = 0;
+    size_t i = 0;
+    for (; i < size; ++i) {
+      const unsigned char c = static_cast<unsigned char>(data[i]);
+      if (base64_value(c) >= 0) {
+        ++character_count;
+      } else if (c != '\r' && c != '\n') {
+        break;
+      }
+    }
+    return i;
+  }
+
+  // decode a run of base64 characters and line breaks, up to limit bytes
+  static void decode_base64(const char* const data, const size_t size,
+                            const uint64_t limit, std::vector<char>& out) {
+    out.clear();
+    uint32_t bits = 0;
+    int bit_count = 0;
+    for (size_t i = 0; i < size && out.size() < limit; ++i) {
+      const int value = base64_value(static_cast<unsigned char>(data[i]));
+      if (value < 0) {
+        continue;
+      }
+      bits = (bits << 6) | static_cast<uint32_t>(value);
+      bit_count += 6;
+      if (bit_count >= 8) {
+        bit_count -= 8;
+        out.push_back(static_cast<char>((bits >> bit_count) & 0xff));
+      }
+    }
+  }
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+  // true if data starts with a gzip header for deflate data
+  static bool is_gzip(const unsigned char* const data, const size_t size) {
+    return size >= 18 && data[0] == 0x1f && data[1] == 0x8b && data[2] == 8;
+  }
+
+  // true if data starts with a zlib header for deflate data with the
+  // default window size and no preset dictionary
+  static bool is_zlib(const unsigned char* const data, const size_t size) {
+    return size >= 6 && data[0] == 0x78 && (data[1] & 0x20) == 0 &&
+           ((data[0] << 8) | data[1]) % 31 == 0;
+  }
+
+  // inflate data, up to limit bytes, returning the number of bytes of data
+  // used.  Output from a truncated or corrupt stream is kept.
+  static size_t inflate_into(const char* const data, const size_t size,
+                             const int window_bits, const uint64_t limit,
+                             std::vector<char>& out) {
+    out.clear();
+    z_stream zs;
+    zs.zalloc = Z_NULL;
+    zs.zfree = Z_NULL;
+    zs.opaque = Z_NULL;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs.avail_in = static_cast<uInt>(std::min<size_t>(size, UINT_MAX));
+    if (inflateInit2(&zs, window_bits) != Z_OK) {
+      return 0;
+    }
+
+    size_t out_size = 0;
+    int status = Z_OK;
+    while (status == Z_OK && out_size < limit) {
+      const size_t chunk_size = static_cast<size_t>(std::min<uint64_t>(
+                                 inflate_chunk_size, limit - out_size));
+      if (out.size() < out_size + chunk_size) {
+        out.resize(out_size + chunk_size);
+      }
+      zs.next_out = reinterpret_cast<Bytef*>(out.data() + out_size);
+      zs.avail_out = static_cast<uInt>(chunk_size);
+      status = inflate(&zs, Z_NO_FLUSH);
+      out_size += chunk_size - zs.avail_out;
+    }
+    const size_t used = static_cast<size_t>(zs.total_in);
+    inflateEnd(&zs);
+    out.resize(out_size);
+    return out_size == 0 ? 0 : used;
+  }
+#endif
+
+  // constructor
+  lw_recursive_scanner_t::lw_recursive_scanner_t(
+                   const lw_scanner_program_t& scanner_program,
+                   decoded_hit_callback_function_t p_decoded_hit_callback,
+                   void* p_user_data,
+                   const size_t p_max_depth,
+                   const uint64_t p_max_decoded_bytes) :
+             scanner(scanner_program, this),
+             decoded_hit_callback(p_decoded_hit_callback),
+             user_data(p_user_data),
+             max_depth(p_max_depth),
+             max_decoded_bytes(p_max_decoded_bytes),
+             decoded_byte_count(0),
+             decoded_buffers(p_max_depth),
+             current_data(nullptr),
+             current_data_size(0),
+             current_depth(0),
+             current_path(),
+             decoded_hits(),
+             program_is_finalized(scanner.program_is_finalized) {
+    scanner.set_batch_callback(batch_callback, 0);
+  }
+
+  // batch_callback
+  void lw_recursive_scanner_t::batch_callback(const lw_hit_t* hits,
+                                              const size_t count,
+                                              void* p_recursive_scanner) {
+    lw_recursive_scanner_t* recursive_scanner =
+              static_cast<lw_recursive_scanner_t*>(p_recursive_scanner);
+    std::vector<lw_decoded_hit_t>& decoded_hits =
+                                       recursive_scanner->decoded_hits;
+    decoded_hits.clear();
+    for (size_t i = 0; i < count; ++i) {
+      const lw_decoded_hit_t decoded_hit = {
+                  hits[i],
+                  recursive_scanner->current_path +
+                                      std::to_string(hits[i].start),
+                  recursive_scanner->current_depth,
+                  recursive_scanner->current_data,
+                  recursive_scanner->current_data_size};
+      decoded_hits.push_back(decoded_hit);
+    }
+    recursive_scanner->decoded_hit_callback(decoded_hits.data(), count,
+                                            recursive_scanner->user_data);
+  }
+
+  // decode
+  size_t lw_recursive_scanner_t::decode(const char* const data,
+                                        const size_t size,
+                                        const size_t depth,
+                                        std::string& type) {
+    const uint64_t limit = max_decoded_bytes - decoded_byte_count;
+    std::vector<char>& out = decoded_buffers[depth];
+    size_t used = 0;
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+    const unsigned char* const bytes =
+                          reinterpret_cast<const unsigned char*>(data);
+    if (is_gzip(bytes, size)) {
+      used = inflate_into(data, size, 16 + MAX_WBITS, limit, out);
+      type = "GZIP";
+    } else if (is_zlib(bytes, size)) {
+      used = inflate_into(data, size, MAX_WBITS, limit, out);
+      type = "ZLIB";
+    }
+    if (used != 0) {
+      decoded_byte_count += out.size();
+      return used;
+    }
+#endif
+
+    size_t character_count;
+    const size_t run_size = base64_run_size(data, size, character_count);
+    if (character_count >= min_base64_size) {
+      decode_base64(data, run_size, limit, out);
+      decoded_byte_count += out.size();
+      used = run_size;
+
+      // include the padding
+      while (used < size && used < run_size + 2 && data[used] == '=') {
+        ++used;
+      }
+      type = "BASE64";
+    }
+    return used;
+  }
+
+  // scan_depth
+  void lw_recursive_scanner_t::scan_depth(const char* const data,
+                                          const size_t size,
+                                          const size_t depth,
+                                          const std::string& path) {
+    current_data = data;
+    current_data_size = size;
+    current_depth = depth;
+    current_path = path;
+    scanner.scan(0, data, size);
+    scanner.scan_finalize();
+    if (depth == max_depth) {
+      return;
+    }
+
+    // decode and scan embedded content until the budget is spent
+    std::string type;
+    size_t i = 0;
+    while (i < size && decoded_byte_count < max_decoded_bytes) {
+      const size_t used = decode(data + i, size - i, depth, type);
+      if (used != 0) {
+        const std::vector<char>& decoded = decoded_buffers[depth];
+        scan_depth(decoded.data(), decoded.size(), depth + 1,
+                   path + std::to_string(i) + "-" + type + "-");
+        i += used;
+        continue;
+      }
+
+      // step past a run of base64 characters too short to decode, up to
+      // its last byte, which may start a zlib header
+      size_t character_count;
+      const size_t run_size = base64_run_size(data + i, size - i,
+                                              character_count);
+      i += (run_size > 1) ? run_size - 1 : 1;
+    }
+  }
+
+  // scan
+  void lw_recursive_scanner_t::scan(const char* const buffer,
+                                    const size_t size) {
+    decoded_byte_count = 0;
+    scan_depth(buffer, size, 0, "");
+  }
+
+  // decoded_bytes
+  uint64_t lw_recursive_scanner_t::decoded_bytes() const {
+    return decoded_byte_count;
+  }
+}
@@ -0,0 +1,110 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include <lightgrep/api.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // runs are found by comparing each block with the block before it
+  static const size_t skip_block_size = 512;
+
+  // search_skipping_runs
+  void lw_scanner_t::search_skipping_runs(const uint64_t stream_offset,
+                                          const char* const buffer,
+                                          const size_t size) {
+
+    size_t search_start = 0;
+    size_t i = skip_block_size;
+    while (i + skip_block_size <= size) {
+
+      // the block differs from the block before it
+      if (std::memcmp(buffer + i, buffer + i - skip_block_size,
+                      skip_block_size) != 0) {
+        i += skip_block_size;
+        continue;
+      }
+
+      // find the end of the run of repeated blocks
+      size_t end = i + skip_block_size;
+      while (end + skip_block_size <= size &&
+             std::memcmp(buffer + end, buffer + end - skip_block_size,
+                         skip_block_size) == 0) {
+        end += skip_block_size;
+      }
+      if (end - i < skip_run_size) {
+        i = end;
+        continue;
+      }
+
+      // search up to the run, resolve matches that extend into it, and
+      // close out the search
+      if (i > search_start) {
+        search(stream_offset + search_start, buffer + search_start,
+               i - search_start);
+      }
+      if (is_search_active) {
+        const size_t fence = (skip_fence_size < end - i) ?
+                                         skip_fence_size : end - i;
+        if (fence != 0) {
+          lg_search_resolve(searcher,
+                            buffer + i,
+                            buffer + i + fence,
+                            stream_offset + i,
+                            hit_callback_data,
+                            hit_callback);
+        }
+        lg_closeout_search(searcher,
+                           hit_callback_data,
+                           hit_callback);
+        lg_reset_context(searcher);
+        prefilter_live_end = 0;
+        is_search_active = false;
+      }
+
+      // resume at the end of the run
+      if (hit_stats.is_enabled) {
+        hit_stats.stats.bytes_skipped += end - i;
+      }
+      search_start = end;
+      i = end;
+    }
+
+    // search the rest
+    if (size > search_start) {
+      search(stream_offset + search_start, buffer + search_start,
+             size - search_start);
+    }
+  }
+
+  // set_run_skipping
+  std::string lw_scanner_t::set_run_skipping(const size_t min_run_size,
+                                             const size_t fence_size) {
+    if (min_run_size != 0 && min_run_size < 2 * skip_block_size) {
+      return "Usage error: min_run_size must be 0 or at least 1024.";
+    }
+    skip_run_size = min_run_size;
+    skip_fence_size = fence_size;
+    return "";
+  }
+}
@@ -0,0 +1,153 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // read path block size and the lookback kept before each block
+  static const size_t read_block_size = 16 * (1 << 20);
+  static const size_t read_lookback_size = 1 << 20;
+
+  static std::string compose_file_error(const std::string& action,
+                                        const int error_number) {
+    std::stringstream ss;
+    ss << "Unable to " << action << ": " << std::strerror(error_number);
+    return ss.str();
+  }
+
+  // scan_file
+  std::string lw_scanner_t::scan_file(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return compose_file_error("open file '" + filename + "'", errno);
+    }
+    const std::string error = scan_fd(fd);
+    ::close(fd);
+    return error;
+  }
+
+  // scan_fd
+  std::string lw_scanner_t::scan_fd(const int fd) {
+
+    // size the input, which works for both files and block devices
+    const off_t end = ::lseek(fd, 0, SEEK_END);
+
+    // map the input if we can
+    if (end > 0) {
+      void* const map = ::mmap(nullptr, static_cast<size_t>(end), PROT_READ,
+                               MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        ::madvise(map, static_cast<size_t>(end), MADV_SEQUENTIAL);
+
+        file_data = static_cast<const char*>(map);
+        file_data_offset = 0;
+        file_data_size = static_cast<size_t>(end);
+        scan(0, file_data, file_data_size);
+        scan_finalize();
+        file_data = nullptr;
+        file_data_size = 0;
+
+        ::munmap(map, static_cast<size_t>(end));
+        return "";
+      }
+    }
+
+    // read the input in blocks, keeping lookback bytes before each block
+    if (::lseek(fd, 0, SEEK_SET) < 0 && errno != ESPIPE) {
+      return compose_file_error("seek", errno);
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    std::vector<char> buffer(read_lookback_size + read_block_size);
+    char* const block = buffer.data() + read_lookback_size;
+    uint64_t offset = 0;
+    size_t lookback = 0;
+    std::string error;
+    while (true) {
+
+      // read a block
+      const ssize_t count = ::read(fd, block, read_block_size);
+      if (count < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        error = compose_file_error("read", errno);
+        break;
+      }
+      if (count == 0) {
+        // EOF
+        break;
+      }
+
+      // scan the block
+      file_data = block - lookback;
+      file_data_offset = offset - lookback;
+      file_data_size = lookback + static_cast<size_t>(count);
+      scan(offset, block, static_cast<size_t>(count));
+      offset += static_cast<uint64_t>(count);
+      if (hit_limits.is_stopped) {
+        break;
+      }
+
+      // move the end of the data to the lookback area, which is the file
+      // data available to callbacks until the next block is scanned,
+      // including callbacks made by scan_finalize
+      const size_t next_lookback = (file_data_size < read_lookback_size) ?
+                                   file_data_size : read_lookback_size;
+      std::memmove(block - next_lookback,
+                   file_data + file_data_size - next_lookback,
+                   next_lookback);
+      lookback = next_lookback;
+      file_data = block - lookback;
+      file_data_offset = offset - lookback;
+      file_data_size = lookback;
+      hit_records.clear_buffers();
+      hit_records.set_buffer(file_data_offset, file_data, file_data_size);
+    }
+
+    scan_finalize();
+    file_data = nullptr;
+    file_data_size = 0;
+    return error;
+  }
+
+  // read_file_data
+  const char* lw_scanner_t::read_file_data(const uint64_t start,
+                                           const uint64_t size) const {
+    if (file_data == nullptr || start < file_data_offset ||
+        start - file_data_offset > file_data_size ||
+        size > file_data_size - (start - file_data_offset)) {
+      return nullptr;
+    }
+    return file_data + (start - file_data_offset);
+  }
+}
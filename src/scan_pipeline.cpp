@@ -0,0 +1,375 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // push and pop yield this many times before waiting to be notified
+  static const int queue_spin_count = 64;
+
+  // A bounded multi-producer multi-consumer queue, after Dmitry Vyukov's
+  // design, that is lock-free while it is neither full nor empty.  push
+  // and pop block while the queue is full or empty, which is the
+  // pipeline's backpressure.  They spin briefly, then wait on a condition
+  // variable so that idle stages do not use a CPU while the disk is slow.
+  template <typename T>
+  class bounded_queue_t {
+
+    private:
+    struct cell_t {
+      std::atomic<size_t> sequence;
+      T data;
+    };
+
+    std::vector<cell_t> cells;
+    const size_t mask;
+    alignas(64) std::atomic<size_t> enqueue_position;
+    alignas(64) std::atomic<size_t> dequeue_position;
+
+    // threads blocked in push or pop
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::atomic<size_t> waiter_count;
+
+    // do not allow copy or assignment
+    bounded_queue_t(const bounded_queue_t&) = delete;
+    bounded_queue_t& operator=(const bounded_queue_t&) = delete;
+
+    static size_t round_up(const size_t capacity) {
+      size_t size = 2;
+      while (size < capacity) {
+        size <<= 1;
+      }
+      return size;
+    }
+
+    public:
+    bounded_queue_t(const size_t capacity) :
+               cells(round_up(capacity)), mask(cells.size() - 1),
+               enqueue_position(0), dequeue_position(0),
+               mutex(), condition(), waiter_count(0) {
+      for (size_t i = 0; i < cells.size(); ++i) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    bool try_push(const T& data) {
+      size_t position = enqueue_position.load(std::memory_order_relaxed);
+      while (true) {
+        cell_t& cell = cells[position & mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const intptr_t difference = static_cast<intptr_t>(sequence) -
+                                    static_cast<intptr_t>(position);
+        if (difference == 0) {
+          if (enqueue_position.compare_exchange_weak(position, position + 1,
+                                      std::memory_order_relaxed)) {
+            cell.data = data;
+            cell.sequence.store(position + 1, std::memory_order_release);
+            return true;
+          }
+        } else if (difference < 0) {
+          // full
+          return false;
+        } else {
+          position = enqueue_position.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    bool try_pop(T& data) {
+      size_t position = dequeue_position.load(std::memory_order_relaxed);
+      while (true) {
+        cell_t& cell = cells[position & mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const intptr_t difference = static_cast<intptr_t>(sequence) -
+                                    static_cast<intptr_t>(position + 1);
+        if (difference == 0) {
+          if (dequeue_position.compare_exchange_weak(position, position + 1,
+                                      std::memory_order_relaxed)) {
+            data = cell.data;
+            cell.sequence.store(position + mask + 1,
+                                std::memory_order_release);
+            return true;
+          }
+        } else if (difference < 0) {
+          // empty
+          return false;
+        } else {
+          position = dequeue_position.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    void push(const T& data) {
+      wait_until([this, &data]() { return try_push(data); });
+      notify_waiters();
+    }
+
+    T pop() {
+      T data;
+      wait_until([this, &data]() { return try_pop(data); });
+      notify_waiters();
+      return data;
+    }
+
+    private:
+    // spin, then wait, until is_done succeeds
+    template <typename F>
+    void wait_until(const F& is_done) {
+      for (int i = 0; i < queue_spin_count; ++i) {
+        if (is_done()) {
+          return;
+        }
+        std::this_thread::yield();
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      ++waiter_count;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      condition.wait(lock, is_done);
+      --waiter_count;
+    }
+
+    // wake blocked threads after a push or pop changed the queue
+    void notify_waiters() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (waiter_count.load() != 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_all();
+      }
+    }
+  };
+
+  // a pooled buffer and the hits found in it
+  struct pipeline_block_t {
+    std::vector<char> data;
+    uint64_t offset;
+    size_t chunk_size;
+    size_t size;
+    std::vector<lw_hit_t> hits;
+    pipeline_block_t(const size_t capacity) :
+               data(capacity), offset(0), chunk_size(0), size(0), hits() {
+    }
+  };
+
+  typedef bounded_queue_t<pipeline_block_t*> block_queue_t;
+
+  // collect a worker scanner's hits into the block being scanned
+  static void collect_block_hits(const lw_hit_t* hits,
+                                 const size_t count,
+                                 void* p_block) {
+    pipeline_block_t* block(*static_cast<pipeline_block_t**>(p_block));
+    block->hits.insert(block->hits.end(), hits, hits + count);
+  }
+
+  // scanning stage, ends at a nullptr block
+  static void scan_blocks(const lw_scanner_program_t* scanner_program,
+                          block_queue_t* scan_queue,
+                          block_queue_t* sink_queue) {
+    pipeline_block_t* block = nullptr;
+    lw_scanner_t scanner(*scanner_program, &block);
+    scanner.set_batch_callback(collect_block_hits, 0);
+    while ((block = scan_queue->pop()) != nullptr) {
+      scanner.scan(block->offset, block->data.data(), block->chunk_size);
+      scanner.scan_fence_finalize(block->offset + block->chunk_size,
+                                  block->data.data() + block->chunk_size,
+                                  block->size - block->chunk_size);
+      sink_queue->push(block);
+    }
+    sink_queue->push(nullptr);
+  }
+
+  // sink stage, ends after a nullptr block from each worker
+  static void sink_blocks(batch_callback_function_t batch_callback,
+                          void* user_data,
+                          const size_t worker_count,
+                          block_queue_t* sink_queue,
+                          block_queue_t* free_queue) {
+    size_t done_count = 0;
+    while (done_count < worker_count) {
+      pipeline_block_t* block = sink_queue->pop();
+      if (block == nullptr) {
+        ++done_count;
+        continue;
+      }
+      if (!block->hits.empty()) {
+        (*batch_callback)(block->hits.data(), block->hits.size(), user_data);
+        block->hits.clear();
+      }
+      free_queue->push(block);
+    }
+  }
+
+  // read until count bytes are read or EOF, returning bytes read or -1
+  static ssize_t read_sequentially(const int fd, char* const buffer,
+                                   const size_t count) {
+    size_t total = 0;
+    while (total < count) {
+      const ssize_t status = ::read(fd, buffer + total, count - total);
+      if (status < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return -1;
+      }
+      if (status == 0) {
+        break;
+      }
+      total += static_cast<size_t>(status);
+    }
+    return static_cast<ssize_t>(total);
+  }
+
+  // constructor
+  lw_scan_pipeline_t::lw_scan_pipeline_t(
+                          const lw_scanner_program_t& p_scanner_program,
+                          batch_callback_function_t p_batch_callback,
+                          void* p_user_data,
+                          const size_t p_worker_count,
+                          const size_t p_chunk_size,
+                          const size_t p_fence_size,
+                          const size_t p_buffer_count) :
+             scanner_program(p_scanner_program),
+             batch_callback(p_batch_callback),
+             user_data(p_user_data),
+             worker_count(p_worker_count == 0 ? 1 : p_worker_count),
+             chunk_size(p_chunk_size == 0 ? 1 : p_chunk_size),
+             fence_size(p_fence_size < p_chunk_size ? p_fence_size :
+                                                      p_chunk_size),
+             // the reader holds two buffers while overlapping fences
+             buffer_count(p_buffer_count < 3 ? 3 : p_buffer_count),
+             program_is_finalized(p_scanner_program.program != nullptr) {
+  }
+
+  // scan_file
+  std::string lw_scan_pipeline_t::scan_file(const std::string& filename) {
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::stringstream ss;
+      ss << "Unable to open file '" << filename << "': "
+         << std::strerror(errno);
+      return ss.str();
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    const std::string error = scan_fd(fd);
+    ::close(fd);
+    return error;
+  }
+
+  // scan_fd
+  std::string lw_scan_pipeline_t::scan_fd(const int fd) {
+
+    if (!program_is_finalized) {
+      return "Usage error: the scanner program must be finalized.";
+    }
+    if (batch_callback == nullptr) {
+      return "Usage error: a batch callback function is required.";
+    }
+
+    // the buffer pool
+    std::vector<pipeline_block_t*> blocks;
+    block_queue_t free_queue(buffer_count);
+    block_queue_t scan_queue(buffer_count + worker_count);
+    block_queue_t sink_queue(buffer_count + worker_count);
+    for (size_t i = 0; i < buffer_count; ++i) {
+      blocks.push_back(new pipeline_block_t(chunk_size + fence_size));
+      free_queue.push(blocks.back());
+    }
+
+    // start the scanning and sink stages
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < worker_count; ++i) {
+      threads.push_back(std::thread(scan_blocks, &scanner_program,
+                                    &scan_queue, &sink_queue));
+    }
+    threads.push_back(std::thread(sink_blocks, batch_callback, user_data,
+                                  worker_count, &sink_queue, &free_queue));
+
+    // the reader stage runs on the calling thread.  A block is passed on
+    // once the next chunk is read and its first bytes are copied into the
+    // block's fence.
+    std::string error;
+    pipeline_block_t* previous = nullptr;
+    uint64_t offset = 0;
+    while (true) {
+      pipeline_block_t* block = free_queue.pop();
+      const ssize_t count = read_sequentially(fd, block->data.data(),
+                                              chunk_size);
+      if (count < 0) {
+        std::stringstream ss;
+        ss << "Read error at offset " << offset << ": "
+           << std::strerror(errno);
+        error = ss.str();
+      }
+      if (count <= 0) {
+        free_queue.push(block);
+        break;
+      }
+      block->offset = offset;
+      block->chunk_size = static_cast<size_t>(count);
+      block->size = block->chunk_size;
+      offset += block->chunk_size;
+
+      if (previous != nullptr) {
+        const size_t fence = (block->chunk_size < fence_size) ?
+                                      block->chunk_size : fence_size;
+        std::memcpy(previous->data.data() + previous->chunk_size,
+                    block->data.data(), fence);
+        previous->size = previous->chunk_size + fence;
+        scan_queue.push(previous);
+      }
+      previous = block;
+
+      if (block->chunk_size < chunk_size) {
+        // EOF
+        break;
+      }
+    }
+    if (previous != nullptr) {
+      scan_queue.push(previous);
+    }
+
+    // stop the workers then wait for all stages to finish
+    for (size_t i = 0; i < worker_count; ++i) {
+      scan_queue.push(nullptr);
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+      it->join();
+    }
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+      delete *it;
+    }
+    return error;
+  }
+}
@@ -0,0 +1,79 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <vector>
+#include <stdint.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // constructor
+  lw_scan_stats_t::lw_scan_stats_t() :
+            hit_counts(), bytes_scanned(0), bytes_skipped(0),
+            search_nanoseconds(0),
+            callback_nanoseconds(0) {
+  }
+
+  // merge
+  void lw_scan_stats_t::merge(const lw_scan_stats_t& other) {
+    if (hit_counts.size() < other.hit_counts.size()) {
+      hit_counts.resize(other.hit_counts.size());
+    }
+    for (size_t i = 0; i < other.hit_counts.size(); ++i) {
+      hit_counts[i] += other.hit_counts[i];
+    }
+    bytes_scanned += other.bytes_scanned;
+    bytes_skipped += other.bytes_skipped;
+    search_nanoseconds += other.search_nanoseconds;
+    callback_nanoseconds += other.callback_nanoseconds;
+  }
+
+  // constructor
+  hit_stats_t::hit_stats_t() :
+            is_enabled(false), is_callback_timed(false),
+            next_callback(nullptr), next_callback_data(nullptr), stats() {
+  }
+
+  // enable_stats
+  void lw_scanner_t::enable_stats(const bool is_callback_timed) {
+    hit_stats.is_enabled = true;
+    hit_stats.is_callback_timed = is_callback_timed;
+    update_hit_callback();
+  }
+
+  // disable_stats
+  void lw_scanner_t::disable_stats() {
+    hit_stats.is_enabled = false;
+    hit_stats.is_callback_timed = false;
+    update_hit_callback();
+  }
+
+  // stats
+  lw_scan_stats_t lw_scanner_t::stats() const {
+    return hit_stats.stats;
+  }
+
+  // reset_stats
+  void lw_scanner_t::reset_stats() {
+    const size_t pattern_count = hit_stats.stats.hit_counts.size();
+    hit_stats.stats = lw_scan_stats_t();
+    hit_stats.stats.hit_counts.resize(pattern_count);
+  }
+}
@@ -0,0 +1,116 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <vector>
+#include <mutex>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // constructor
+  lw_scanner_lease_t::lw_scanner_lease_t(lw_scanner_pool_t* p_pool,
+                                         lw_scanner_t* p_scanner) :
+             pool(p_pool), scanner(p_scanner) {
+  }
+
+  // move constructor
+  lw_scanner_lease_t::lw_scanner_lease_t(lw_scanner_lease_t&& other) :
+             pool(other.pool), scanner(other.scanner) {
+    other.pool = nullptr;
+    other.scanner = nullptr;
+  }
+
+  // destructor
+  lw_scanner_lease_t::~lw_scanner_lease_t() {
+    if (pool != nullptr) {
+      pool->release(scanner);
+    }
+  }
+
+  // constructor
+  lw_scanner_pool_t::lw_scanner_pool_t(
+                          const lw_scanner_program_t& p_scanner_program,
+                          const size_t initial_count) :
+             scanner_program(p_scanner_program),
+             scanners_mutex(),
+             available_scanners(),
+             scanner_count(initial_count),
+             program_is_finalized(p_scanner_program.program != nullptr) {
+    for (size_t i = 0; i < initial_count; ++i) {
+      available_scanners.push_back(new lw_scanner_t(scanner_program,
+                                                    nullptr));
+    }
+  }
+
+  // destructor
+  lw_scanner_pool_t::~lw_scanner_pool_t() {
+    for (auto it = available_scanners.begin();
+              it != available_scanners.end(); ++it) {
+      delete *it;
+    }
+  }
+
+  // acquire
+  lw_scanner_lease_t lw_scanner_pool_t::acquire(void* user_data) {
+    lw_scanner_t* scanner = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(scanners_mutex);
+      if (!available_scanners.empty()) {
+        scanner = available_scanners.back();
+        available_scanners.pop_back();
+      } else {
+        ++scanner_count;
+      }
+    }
+
+    // create a new scanner outside the lock
+    if (scanner == nullptr) {
+      scanner = new lw_scanner_t(scanner_program, user_data);
+    } else {
+      scanner->reset(user_data);
+    }
+    return lw_scanner_lease_t(this, scanner);
+  }
+
+  // release
+  void lw_scanner_pool_t::release(lw_scanner_t* scanner) {
+
+    // discard held hits, batches, and records so that they are not
+    // delivered with the ended lease's user data, then restore default
+    // hit modes so the next lease starts clean
+    scanner->reset(nullptr);
+    scanner->set_batch_callback(nullptr, 0);
+    scanner->set_record_callback(nullptr, 0, 0, 0);
+    scanner->set_hit_filter(LW_FILTER_NONE, 0);
+    scanner->set_hit_limits(0, 0);
+    scanner->set_run_skipping(0, 0);
+    scanner->disable_stats();
+    scanner->reset_stats();
+
+    std::lock_guard<std::mutex> lock(scanners_mutex);
+    available_scanners.push_back(scanner);
+  }
+
+  // size
+  size_t lw_scanner_pool_t::size() {
+    std::lock_guard<std::mutex> lock(scanners_mutex);
+    return scanner_count;
+  }
+}
@@ -0,0 +1,377 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <stdint.h>
+#include "lightgrep_wrapper.hpp"
+
+namespace lw {
+
+  // estimate the automaton cost of a regex
+  static uint64_t estimate_cost(const lw_regex_spec_t& spec) {
+    uint64_t cost = (spec.regex.size() + 1) *
+                    encoding_width(spec.character_encoding);
+
+    // case folding adds a transition per cased character
+    if (spec.is_case_insensitive) {
+      cost *= 2;
+    }
+
+    // repetition can multiply states, particularly when determinized
+    if (!spec.is_fixed_string) {
+      const uint64_t repetitions = std::count_if(spec.regex.begin(),
+                                                 spec.regex.end(),
+                    [](char c) { return c == '*' || c == '+' || c == '{'; });
+      cost *= 1 + repetitions;
+    }
+    return cost;
+  }
+
+  // add a shard's regexes in order, recording accepted pattern indices
+  static void build_shard(lw_scanner_program_t* shard,
+                          const std::vector<lw_regex_spec_t>* regex_specs,
+                          const std::vector<uint32_t>* assigned_indices,
+                          std::vector<uint32_t>* pattern_indices,
+                          std::vector<std::string>* errors) {
+    for (auto it = assigned_indices->begin(); it != assigned_indices->end();
+                                                                      ++it) {
+      const lw_regex_spec_t& spec = (*regex_specs)[*it];
+      (*errors)[*it] = shard->add_regex(spec.regex, spec.character_encoding,
+                                        spec.is_case_insensitive,
+                                        spec.is_fixed_string, spec.f);
+      if ((*errors)[*it] == "") {
+        pattern_indices->push_back(*it);
+      }
+    }
+  }
+
+  // constructor
+  lw_sharded_program_t::lw_sharded_program_t(const size_t p_shard_count) :
+             shards(), pattern_indices(), function_pointers() {
+    const size_t count = (p_shard_count == 0) ? 1 : p_shard_count;
+    for (size_t i = 0; i < count; ++i) {
+      shards.push_back(new lw_scanner_program_t());
+    }
+    pattern_indices.resize(count);
+  }
+
+  // destructor
+  lw_sharded_program_t::~lw_sharded_program_t() {
+    for (auto it = shards.begin(); it != shards.end(); ++it) {
+      delete *it;
+    }
+  }
+
+  // add_regexes
+  std::string lw_sharded_program_t::add_regexes(
+                         const std::vector<lw_regex_spec_t>& regex_specs) {
+
+    if (!function_pointers.empty()) {
+      return "Usage error: add all regexes to a sharded program at once.";
+    }
+
+    // assign the most costly regexes first, each to the least loaded shard
+    std::vector<uint32_t> order(regex_specs.size());
+    std::vector<uint64_t> costs(regex_specs.size());
+    for (size_t i = 0; i < regex_specs.size(); ++i) {
+      order[i] = static_cast<uint32_t>(i);
+      costs[i] = estimate_cost(regex_specs[i]);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&costs](uint32_t a, uint32_t b) {
+                       return costs[a] > costs[b]; });
+    std::vector<uint64_t> loads(shards.size(), 0);
+    std::vector<std::vector<uint32_t> > assigned_indices(shards.size());
+    for (auto it = order.begin(); it != order.end(); ++it) {
+      const size_t shard = std::min_element(loads.begin(), loads.end()) -
+                           loads.begin();
+      loads[shard] += costs[*it];
+      assigned_indices[shard].push_back(*it);
+    }
+
+    // build the shards concurrently, keeping original order within each
+    std::vector<std::string> errors(regex_specs.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < shards.size(); ++i) {
+      std::sort(assigned_indices[i].begin(), assigned_indices[i].end());
+      threads.push_back(std::thread(build_shard, shards[i], &regex_specs,
+                                    &assigned_indices[i],
+                                    &pattern_indices[i], &errors));
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+      it->join();
+    }
+
+    // callbacks are indexed by original pattern index
+    std::stringstream ss;
+    for (size_t i = 0; i < regex_specs.size(); ++i) {
+      function_pointers.push_back(regex_specs[i].f);
+      if (errors[i] != "") {
+        ss << errors[i] << "\n";
+      }
+    }
+    return ss.str();
+  }
+
+  // finalize_program
+  void lw_sharded_program_t::finalize_program(const bool is_determinized,
+                                              const size_t thread_count) {
+
+    // shards without patterns are not used
+    std::vector<lw_scanner_program_t*> used_shards;
+    for (size_t i = 0; i < shards.size(); ++i) {
+      if (!pattern_indices[i].empty()) {
+        used_shards.push_back(shards[i]);
+      }
+    }
+    lw_scanner_program_t::finalize_programs(used_shards, is_determinized,
+                                            thread_count);
+  }
+
+  // shard_count
+  size_t lw_sharded_program_t::shard_count() const {
+    return shards.size();
+  }
+
+  // collect the hits from a shard scanner
+  static void collect_shard_hits(const lw_hit_t* hits,
+                                 const size_t count,
+                                 void* p_shard_hits) {
+    std::vector<lw_hit_t>* shard_hits(
+                         static_cast<std::vector<lw_hit_t>*>(p_shard_hits));
+    shard_hits->insert(shard_hits->end(), hits, hits + count);
+  }
+
+  // the scan functions that run on each shard scanner
+  static void scan_one(lw_scanner_t* scanner, uint64_t stream_offset,
+                       const char* buffer, size_t size) {
+    scanner->scan(stream_offset, buffer, size);
+  }
+
+  static void scan_finalize_one(lw_scanner_t* scanner, uint64_t,
+                                const char*, size_t) {
+    scanner->scan_finalize();
+  }
+
+  static void scan_fence_finalize_one(lw_scanner_t* scanner,
+                                      uint64_t stream_offset,
+                                      const char* buffer, size_t size) {
+    scanner->scan_fence_finalize(stream_offset, buffer, size);
+  }
+
+  // create a scanner for each used shard that collects hits into
+  // shard_hits
+  static std::vector<lw_scanner_t*> create_shard_scanners(
+                     const std::vector<lw_scanner_program_t*>& shards,
+                     const std::vector<std::vector<uint32_t> >& pattern_indices,
+                     std::vector<std::vector<lw_hit_t> >& shard_hits) {
+    std::vector<lw_scanner_t*> scanners;
+    for (size_t i = 0; i < shards.size(); ++i) {
+      if (pattern_indices[i].empty()) {
+        // shards without patterns are not used
+        continue;
+      }
+      lw_scanner_t* scanner = new lw_scanner_t(*shards[i], &shard_hits[i]);
+      scanner->set_batch_callback(collect_shard_hits, 0);
+      scanners.push_back(scanner);
+    }
+    return scanners;
+  }
+
+  static bool shards_are_finalized(const std::vector<lw_scanner_t*>& scanners) {
+    if (scanners.empty()) {
+      return false;
+    }
+    for (auto it = scanners.begin(); it != scanners.end(); ++it) {
+      if (!(*it)->program_is_finalized) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // constructor
+  lw_sharded_scanner_t::lw_sharded_scanner_t(
+                          const lw_sharded_program_t& p_sharded_program,
+                          void* p_user_data,
+                          const bool p_is_threaded) :
+             sharded_program(p_sharded_program),
+             user_data(p_user_data),
+             is_threaded(p_is_threaded),
+             shard_hits(p_sharded_program.shards.size()),
+             scanners(create_shard_scanners(p_sharded_program.shards,
+                                     p_sharded_program.pattern_indices,
+                                     shard_hits)),
+             hits(),
+             batch_callback(nullptr),
+             workers(), mutex(), condition(), task_function(nullptr),
+             task_stream_offset(0), task_buffer(nullptr), task_size(0),
+             task_generation(0), tasks_remaining(0), is_stopping(false),
+             program_is_finalized(shards_are_finalized(scanners)) {
+
+    // start the workers once rather than a thread per scan call
+    if (is_threaded && program_is_finalized) {
+      for (size_t i = 1; i < scanners.size(); ++i) {
+        workers.push_back(std::thread(&lw_sharded_scanner_t::work_loop,
+                                      this, i));
+      }
+    }
+  }
+
+  // destructor
+  lw_sharded_scanner_t::~lw_sharded_scanner_t() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      is_stopping = true;
+      condition.notify_all();
+    }
+    for (auto it = workers.begin(); it != workers.end(); ++it) {
+      it->join();
+    }
+    for (auto it = scanners.begin(); it != scanners.end(); ++it) {
+      delete *it;
+    }
+  }
+
+  // work_loop
+  void lw_sharded_scanner_t::work_loop(const size_t scanner_index) {
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      condition.wait(lock, [this, generation] {
+                     return is_stopping || task_generation != generation; });
+      if (is_stopping) {
+        return;
+      }
+
+      // run the task without holding the lock
+      generation = task_generation;
+      void (*scan_function)(lw_scanner_t*, uint64_t, const char*, size_t) =
+                                                             task_function;
+      const uint64_t stream_offset = task_stream_offset;
+      const char* const buffer = task_buffer;
+      const size_t size = task_size;
+      lock.unlock();
+      scan_function(scanners[scanner_index], stream_offset, buffer, size);
+      lock.lock();
+
+      // the last worker to finish wakes the calling thread
+      if (--tasks_remaining == 0) {
+        condition.notify_all();
+      }
+    }
+  }
+
+  // scan_shards
+  void lw_sharded_scanner_t::scan_shards(
+                     void (*scan_function)(lw_scanner_t*, uint64_t,
+                                           const char*, size_t),
+                     uint64_t stream_offset,
+                     const char* const buffer, size_t size) {
+
+    if (!program_is_finalized) {
+      return;
+    }
+
+    // scan with each shard
+    if (!workers.empty()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        task_function = scan_function;
+        task_stream_offset = stream_offset;
+        task_buffer = buffer;
+        task_size = size;
+        tasks_remaining = workers.size();
+        ++task_generation;
+        condition.notify_all();
+      }
+      scan_function(scanners[0], stream_offset, buffer, size);
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this] { return tasks_remaining == 0; });
+    } else {
+      for (auto it = scanners.begin(); it != scanners.end(); ++it) {
+        scan_function(*it, stream_offset, buffer, size);
+      }
+    }
+
+    // merge the hits, mapping pattern indices back to the original order
+    hits.clear();
+    for (size_t i = 0; i < shard_hits.size(); ++i) {
+      const std::vector<uint32_t>& pattern_indices =
+                                    sharded_program.pattern_indices[i];
+      for (auto it = shard_hits[i].begin(); it != shard_hits[i].end(); ++it) {
+        lw_hit_t hit = *it;
+        hit.pattern_index = pattern_indices[hit.pattern_index];
+        hit.logical_index = hit.pattern_index;
+        hits.push_back(hit);
+      }
+      shard_hits[i].clear();
+    }
+    std::sort(hits.begin(), hits.end(),
+              [](const lw_hit_t& a, const lw_hit_t& b) {
+                return (a.start != b.start) ? a.start < b.start :
+                                    a.pattern_index < b.pattern_index; });
+
+    // deliver the hits
+    if (hits.empty()) {
+      return;
+    }
+    if (batch_callback != nullptr) {
+      (*batch_callback)(hits.data(), hits.size(), user_data);
+    } else {
+      const std::vector<scan_callback_function_t>& function_pointers =
+                                    sharded_program.function_pointers;
+      for (auto it = hits.begin(); it != hits.end(); ++it) {
+        (*function_pointers[it->pattern_index])(it->start, it->size,
+                                                user_data);
+      }
+    }
+  }
+
+  // scan
+  void lw_sharded_scanner_t::scan(uint64_t stream_offset,
+                                  const char* const buffer, size_t size) {
+    scan_shards(scan_one, stream_offset, buffer, size);
+  }
+
+  // scan_finalize
+  void lw_sharded_scanner_t::scan_finalize() {
+    scan_shards(scan_finalize_one, 0, nullptr, 0);
+  }
+
+  // scan_fence_finalize
+  void lw_sharded_scanner_t::scan_fence_finalize(uint64_t stream_offset,
+                                                 const char* const buffer,
+                                                 size_t size) {
+    scan_shards(scan_fence_finalize_one, stream_offset, buffer, size);
+  }
+
+  // set_batch_callback
+  void lw_sharded_scanner_t::set_batch_callback(
+                         batch_callback_function_t p_batch_callback) {
+    batch_callback = p_batch_callback;
+  }
+}
@@ -0,0 +1,138 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+#include <config.h>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "lightgrep_wrapper.hpp"
+
+// Stream byte at offset o is kept at ring position o % ring.size().
+
+namespace lw {
+
+  // constructor
+  lw_stream_scanner_t::lw_stream_scanner_t(
+                          const lw_scanner_program_t& scanner_program,
+                          void* user_data,
+                          const size_t lookback_size) :
+             scanner(scanner_program, user_data),
+             ring(lookback_size == 0 ? 1 : lookback_size),
+             next_offset(0),
+             history_size(0),
+             push_data(nullptr),
+             push_size(0),
+             program_is_finalized(scanner.program_is_finalized) {
+  }
+
+  // push
+  void lw_stream_scanner_t::push(const char* const data, const size_t size) {
+
+    // scan directly from the pushed data
+    push_data = data;
+    push_size = size;
+    scanner.scan(next_offset, data, size);
+    push_data = nullptr;
+    push_size = 0;
+
+    // keep the end of the pushed data in the ring buffer
+    const size_t keep = (size < ring.size()) ? size : ring.size();
+    const uint64_t keep_offset = next_offset + size - keep;
+    const size_t position = static_cast<size_t>(keep_offset % ring.size());
+    const size_t first = (keep < ring.size() - position) ?
+                                        keep : ring.size() - position;
+    std::memcpy(&ring[position], data + size - keep, first);
+    std::memcpy(&ring[0], data + size - keep + first, keep - first);
+
+    next_offset += size;
+    history_size = (history_size + keep < ring.size()) ?
+                                        history_size + keep : ring.size();
+  }
+
+  // finalize
+  void lw_stream_scanner_t::finalize() {
+    scanner.scan_finalize();
+    next_offset = 0;
+    history_size = 0;
+  }
+
+  // stream_offset
+  uint64_t lw_stream_scanner_t::stream_offset() const {
+    return next_offset;
+  }
+
+  // copy_from_ring
+  void lw_stream_scanner_t::copy_from_ring(uint64_t start, uint64_t end,
+                                           std::string& data) const {
+    while (start < end) {
+      const size_t position = static_cast<size_t>(start % ring.size());
+      const uint64_t count = (end - start < ring.size() - position) ?
+                                       end - start : ring.size() - position;
+      data.append(&ring[position], static_cast<size_t>(count));
+      start += count;
+    }
+  }
+
+  // read_into
+  void lw_stream_scanner_t::read_into(const uint64_t start,
+                                      const uint64_t size,
+                                      const size_t padding,
+                                      std::string& data) const {
+    data.clear();
+
+    // the available bytes are the ring history and the pushed data
+    const uint64_t history_begin = next_offset - history_size;
+    const uint64_t available_end = next_offset + push_size;
+
+    // requested range, bounded by what is available
+    uint64_t begin = (start < padding) ? 0 : start - padding;
+    if (begin < history_begin) {
+      begin = history_begin;
+    }
+    uint64_t end = start + size + padding;
+    if (end > available_end) {
+      end = available_end;
+    }
+    if (begin >= end) {
+      return;
+    }
+
+    // part in ring buffer
+    if (begin < next_offset) {
+      copy_from_ring(begin, (end < next_offset) ? end : next_offset, data);
+    }
+
+    // part in pushed data
+    if (end > next_offset) {
+      const uint64_t push_begin = (begin > next_offset) ? begin : next_offset;
+      data.append(push_data + (push_begin - next_offset),
+                  static_cast<size_t>(end - push_begin));
+    }
+  }
+
+  // read
+  std::string lw_stream_scanner_t::read(const uint64_t start,
+                                        const uint64_t size,
+                                        const size_t padding) const {
+    std::string data;
+    read_into(start, size, padding, data);
+    return data;
+  }
+}
@@ -0,0 +1,250 @@
+// Author:  Bruce Allen
+// Created: 5/26/2017
+//
+// The software provided here is released by the Naval Postgraduate
+// School, an agency of the U.S. Department of Navy.  The software
+// bears no warranty, either expressed or implied. NPS does not assume
+// legal liability nor responsibility for a User's use of the software
+// or the results of such use.
+//
+// Please note that within the United States, copyright protection,
+// under Section 105 of the United States Code, Title 17, is not
+// available for any work of the United States Government and/or for
+// any works created by United States Government employees. User
+// acknowledges that this software contains work which was created by
+// NPS government employees and is therefore in the public domain and
+// not subject to copyright.
+//
+// Released into the public domain on May 26, 2017 by Bruce Allen.
+
+// Scan throughput benchmark.
+//
+// Usage: bench [corpus MiB [max keywords]]
+//
+// Scans deterministic synthetic corpora with pattern sets of 1, 100,
+// 10k, and 100k fixed-string keywords, as NFA and as DFA, using several
+// buffer sizes, and reports add_regex and finalize time, per-context
+// memory, MB/s, and hits/s.  Results depend only on the arguments so
+// runs are comparable across lightgrep versions.
+
+#include <config.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+#include "../src/lightgrep_wrapper.hpp"
+
+// deterministic pseudo-random numbers, xorshift64*
+class prng_t {
+  private:
+  uint64_t state;
+
+  public:
+  prng_t(const uint64_t seed) : state(seed) {
+  }
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+  }
+};
+
+// the nth set of keywords is the first n keywords so all sets contain
+// keyword 0, which the hit corpora use
+std::vector<std::string> keywords(const size_t count) {
+  prng_t prng(0x6c67);
+  std::vector<std::string> words;
+  for (size_t i = 0; i < count; ++i) {
+    std::string word;
+    const size_t size = 8 + prng.next() % 5;
+    for (size_t j = 0; j < size; ++j) {
+      word += static_cast<char>('a' + prng.next() % 26);
+    }
+    words.push_back(word);
+  }
+  return words;
+}
+
+// append a random lowercase word followed by a space
+void append_word(prng_t& prng, std::string& text) {
+  const size_t size = 2 + prng.next() % 8;
+  for (size_t j = 0; j < size; ++j) {
+    text += static_cast<char>('a' + prng.next() % 26);
+  }
+  text += ' ';
+}
+
+enum corpus_type_t {RANDOM_BINARY, ASCII_TEXT, UTF16LE_TEXT, HIT_DENSE,
+                    HIT_SPARSE};
+
+const char* corpus_name(const corpus_type_t type) {
+  switch (type) {
+    case RANDOM_BINARY: return "binary";
+    case ASCII_TEXT: return "ascii";
+    case UTF16LE_TEXT: return "utf16le";
+    case HIT_DENSE: return "dense";
+    case HIT_SPARSE: return "sparse";
+  }
+  return "";
+}
+
+std::string corpus(const corpus_type_t type, const size_t size) {
+  prng_t prng(0x6277 + type);
+  const std::string keyword = keywords(1)[0];
+  std::string text;
+  text.reserve(size + 64);
+  switch (type) {
+    case RANDOM_BINARY:
+      while (text.size() < size) {
+        const uint64_t value = prng.next();
+        text.append(reinterpret_cast<const char*>(&value), sizeof(value));
+      }
+      break;
+    case ASCII_TEXT:
+      while (text.size() < size) {
+        append_word(prng, text);
+      }
+      break;
+    case UTF16LE_TEXT: {
+      std::string word;
+      while (text.size() < size) {
+        word.clear();
+        append_word(prng, word);
+        for (auto it = word.begin(); it != word.end(); ++it) {
+          text += *it;
+          text += '\0';
+        }
+      }
+      break;
+    }
+    case HIT_DENSE:
+      while (text.size() < size) {
+        text += keyword + ' ';
+        append_word(prng, text);
+      }
+      break;
+    case HIT_SPARSE:
+      while (text.size() < size) {
+        if (prng.next() % 8192 == 0) {
+          text += keyword + ' ';
+        }
+        append_word(prng, text);
+      }
+      break;
+  }
+  text.resize(size);
+  return text;
+}
+
+void count_function(const uint64_t,
+                    const uint64_t,
+                    void* p_count) {
+  ++*static_cast<uint64_t*>(p_count);
+}
+
+double seconds_since(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start).count();
+}
+
+// bytes allocated from the heap
+size_t heap_bytes() {
+#if defined(HAVE_MALLINFO2)
+  return mallinfo2().uordblks;
+#elif defined(HAVE_MALLINFO)
+  return static_cast<size_t>(mallinfo().uordblks);
+#else
+  return 0;
+#endif
+}
+
+int main(int argc, char* argv[]) {
+
+  const size_t corpus_size = (argc > 1 ? std::atol(argv[1]) : 32) << 20;
+  const size_t max_keywords = argc > 2 ? std::atol(argv[2]) : 100000;
+  const size_t keyword_counts[] = {1, 100, 10000, 100000};
+  const size_t buffer_sizes[] = {1 << 16, 1 << 20, 1 << 24};
+  const corpus_type_t corpus_types[] = {RANDOM_BINARY, ASCII_TEXT,
+                                        UTF16LE_TEXT, HIT_DENSE, HIT_SPARSE};
+
+  std::cout << "lightgrep_wrapper " << lightgrep_wrapper_version()
+            << " bench, corpus size " << (corpus_size >> 20) << " MiB\n"
+            << std::setw(8) << "keywords" << std::setw(5) << "dfa"
+            << std::setw(10) << "add_s" << std::setw(12) << "finalize_s"
+            << std::setw(12) << "context_b"
+            << std::setw(9) << "corpus" << std::setw(10) << "buffer"
+            << std::setw(10) << "MB/s" << std::setw(14) << "hits/s"
+            << std::setw(12) << "hits" << "\n";
+  std::cout << std::fixed;
+
+  for (auto type = std::begin(corpus_types); type != std::end(corpus_types);
+                                                                   ++type) {
+    const std::string text = corpus(*type, corpus_size);
+
+    for (auto keyword_count = std::begin(keyword_counts);
+         keyword_count != std::end(keyword_counts); ++keyword_count) {
+      if (*keyword_count > max_keywords) {
+        continue;
+      }
+      const std::vector<std::string> words = keywords(*keyword_count);
+
+      for (int is_determinized = 0; is_determinized < 2; ++is_determinized) {
+
+        // compile
+        auto start = std::chrono::steady_clock::now();
+        lw::lw_scanner_program_t program;
+        for (auto it = words.begin(); it != words.end(); ++it) {
+          program.add_regex(*it, "UTF-8", false, true, &count_function);
+        }
+        const double add_seconds = seconds_since(start);
+        start = std::chrono::steady_clock::now();
+        program.finalize_program(is_determinized != 0);
+        const double finalize_seconds = seconds_since(start);
+
+        for (auto buffer_size = std::begin(buffer_sizes);
+             buffer_size != std::end(buffer_sizes); ++buffer_size) {
+
+          // create a context
+          uint64_t count = 0;
+          const size_t heap_before = heap_bytes();
+          lw::lw_scanner_t scanner(program, &count);
+          const size_t context_bytes = heap_bytes() - heap_before;
+
+          // scan
+          start = std::chrono::steady_clock::now();
+          for (size_t offset = 0; offset < text.size();
+                                  offset += *buffer_size) {
+            const size_t size = (text.size() - offset < *buffer_size) ?
+                                text.size() - offset : *buffer_size;
+            scanner.scan(offset, text.c_str() + offset, size);
+          }
+          scanner.scan_finalize();
+          const double scan_seconds = seconds_since(start);
+
+          std::cout << std::setw(8) << *keyword_count
+                    << std::setw(5) << is_determinized
+                    << std::setprecision(3)
+                    << std::setw(10) << add_seconds
+                    << std::setw(12) << finalize_seconds
+                    << std::setw(12) << context_bytes
+                    << std::setw(9) << corpus_name(*type)
+                    << std::setw(10) << *buffer_size
+                    << std::setw(10) << std::setprecision(1)
+                    << text.size() / scan_seconds / 1000000.0
+                    << std::setw(14) << std::setprecision(0)
+                    << count / scan_seconds
+                    << std::setw(12) << count << std::endl;
+        }
+      }
+    }
+  }
+  return 0;
+}
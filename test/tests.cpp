@@ -19,12 +19,19 @@
 
 #include <config.h>
 #include <cstdio>
+#include <cstring>
 #include <cstdint>
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <thread>
 #include <cassert>
+#include <unistd.h>
+#include <sched.h>
 #include "unit_test.h"
 #include "../src/lightgrep_wrapper.hpp"
+#include "../src/lightgrep_wrapper.h"
 
 class user_data_t {
   private:
@@ -172,6 +179,1496 @@ void test1() {
   TEST_EQ(user_data.matches.size(), 20);
 }
 
+// hits collected as text for comparing scan results
+typedef std::vector<std::string> hit_list_t;
+
+void collect(const std::string& name,
+             const uint64_t start,
+             const uint64_t size,
+             void* p_hit_list) {
+  hit_list_t* hit_list(static_cast<hit_list_t*>(p_hit_list));
+  std::stringstream ss;
+  ss << name << " " << start << " " << size;
+  hit_list->push_back(ss.str());
+}
+
+void collect_function1(const uint64_t start,
+                       const uint64_t size,
+                       void* p_hit_list) {
+  collect("abc", start, size, p_hit_list);
+}
+
+void collect_function2(const uint64_t start,
+                       const uint64_t size,
+                       void* p_hit_list) {
+  collect("bc", start, size, p_hit_list);
+}
+
+void collect_function3(const uint64_t start,
+                       const uint64_t size,
+                       void* p_hit_list) {
+  collect("cab", start, size, p_hit_list);
+}
+
+// data and program used for comparing scan results
+std::string test_data() {
+  std::string data;
+  for (int i = 0; i < 100; ++i) {
+    data += "abcbabcbabcbabc";
+  }
+  return data;
+}
+
+void add_collect_regexes(lw::lw_scanner_program_t& lw) {
+  lw.add_regex("abc", "UTF-8", false, false, &collect_function1);
+  lw.add_regex("bc", "UTF-8", false, false, &collect_function2);
+  lw.add_regex("cab", "UTF-8", false, false, &collect_function3);
+}
+
+// the hits from a single-threaded scan of the whole buffer
+hit_list_t expected_hits(const lw::lw_scanner_program_t& lw,
+                         const std::string& data) {
+  hit_list_t hit_list;
+  lw::lw_scanner_t lw_scanner(lw, &hit_list);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  std::sort(hit_list.begin(), hit_list.end());
+  return hit_list;
+}
+
+void test_parallel_scanner() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  const hit_list_t expected = expected_hits(lw, data);
+  TEST_EQ(expected.size(), 899);
+
+  // one hit list per thread
+  std::vector<hit_list_t> hit_lists(4);
+  std::vector<void*> user_data;
+  for (auto it = hit_lists.begin(); it != hit_lists.end(); ++it) {
+    user_data.push_back(&*it);
+  }
+
+  // chunk size 7 is not aligned with the data so hits cross chunks
+  lw::lw_parallel_scanner_t parallel_scanner(lw, user_data, 7, 16);
+  TEST_EQ(parallel_scanner.program_is_finalized, true);
+
+  // scan buffer
+  parallel_scanner.scan(0, data.c_str(), data.size());
+  hit_list_t hits;
+  for (auto it = hit_lists.begin(); it != hit_lists.end(); ++it) {
+    hits.insert(hits.end(), it->begin(), it->end());
+    it->clear();
+  }
+  std::sort(hits.begin(), hits.end());
+  TEST_EQ(hits.size(), expected.size());
+  TEST_EQ((hits == expected), true);
+
+  // scan file
+  const std::string filename = "temp_parallel_scanner_file";
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  out << data;
+  out.close();
+  TEST_EQ(parallel_scanner.scan_file(filename), "");
+  std::remove(filename.c_str());
+  hits.clear();
+  for (auto it = hit_lists.begin(); it != hit_lists.end(); ++it) {
+    hits.insert(hits.end(), it->begin(), it->end());
+  }
+  std::sort(hits.begin(), hits.end());
+  TEST_EQ((hits == expected), true);
+
+  // missing file
+  TEST_EQ(parallel_scanner.scan_file(filename).empty(), false);
+}
+
+// batches collected as hit text and batch sizes
+class batches_t {
+  public:
+  hit_list_t hit_list;
+  std::vector<size_t> batch_sizes;
+  batches_t() : hit_list(), batch_sizes() {
+  }
+};
+
+void batch_function(const lw::lw_hit_t* hits,
+                    const size_t count,
+                    void* p_batches) {
+  const char* names[] = {"abc", "bc", "cab"};
+  batches_t* batches(static_cast<batches_t*>(p_batches));
+  for (size_t i = 0; i < count; ++i) {
+    collect(names[hits[i].pattern_index], hits[i].start, hits[i].size,
+            &batches->hit_list);
+  }
+  batches->batch_sizes.push_back(count);
+}
+
+void test_batch_callback() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  const hit_list_t expected = expected_hits(lw, data);
+
+  // one batch per scan call
+  batches_t batches;
+  lw::lw_scanner_t lw_scanner(lw, &batches);
+  TEST_EQ(lw_scanner.set_batch_callback(batch_function, 0), "");
+  lw_scanner.scan(0, data.c_str(), 100);
+  lw_scanner.scan(100, data.c_str() + 100, data.size() - 100);
+  lw_scanner.scan_finalize();
+  TEST_EQ(batches.batch_sizes.size(), 2);
+  std::sort(batches.hit_list.begin(), batches.hit_list.end());
+  TEST_EQ((batches.hit_list == expected), true);
+
+  // batches of at most 16 hits in a caller-provided array
+  lw::lw_hit_t hits[16];
+  batches.hit_list.clear();
+  batches.batch_sizes.clear();
+  TEST_EQ(lw_scanner.set_batch_callback(batch_function, 0, hits).empty(),
+          false);
+  TEST_EQ(lw_scanner.set_batch_callback(batch_function, 16, hits), "");
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(batches.batch_sizes.size(), (expected.size() + 15) / 16);
+  TEST_EQ(batches.batch_sizes[0], 16);
+  std::sort(batches.hit_list.begin(), batches.hit_list.end());
+  TEST_EQ((batches.hit_list == expected), true);
+
+  // back to per-pattern callbacks
+  TEST_EQ(lw_scanner.set_batch_callback(nullptr, 0), "");
+}
+
+// basic_scanner handler that collects hit text
+class collect_handler_t {
+  public:
+  hit_list_t hit_list;
+  collect_handler_t() : hit_list() {
+  }
+  void on_hit(const uint32_t pattern_index,
+              const uint64_t start,
+              const uint64_t size) {
+    const char* names[] = {"abc", "bc", "cab"};
+    collect(names[pattern_index], start, size, &hit_list);
+  }
+};
+
+void test_basic_scanner() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  const hit_list_t expected = expected_hits(lw, data);
+
+  // handler class
+  lw::basic_scanner<collect_handler_t> scanner(lw, collect_handler_t());
+  TEST_EQ(scanner.program_is_finalized, true);
+  scanner.scan(0, data.c_str(), 20);
+  scanner.scan(20, data.c_str() + 20, data.size() - 20);
+  scanner.scan_finalize();
+  std::sort(scanner.handler.hit_list.begin(), scanner.handler.hit_list.end());
+  TEST_EQ((scanner.handler.hit_list == expected), true);
+
+  // lambda
+  size_t count = 0;
+  auto f = [&count](uint32_t, uint64_t, uint64_t) { ++count; };
+  lw::basic_scanner<lw::callable_handler_t<decltype(f)> > lambda_scanner(lw, f);
+  lambda_scanner.scan(0, data.c_str(), data.size());
+  lambda_scanner.scan_finalize();
+  TEST_EQ(count, expected.size());
+}
+
+// check match data read in place during scan_file
+class file_check_t {
+  public:
+  lw::lw_scanner_t* lw_scanner;
+  size_t matches;
+  size_t mismatches;
+  file_check_t() : lw_scanner(nullptr), matches(0), mismatches(0) {
+  }
+};
+
+template <int N>
+void file_check_function(const uint64_t start,
+                         const uint64_t size,
+                         void* p_file_check) {
+  const char* names[] = {"abc", "bc", "cab"};
+  file_check_t* file_check(static_cast<file_check_t*>(p_file_check));
+  const char* data = file_check->lw_scanner->read_file_data(start, size);
+  if (data != nullptr && std::string(data, size) == names[N]) {
+    ++file_check->matches;
+  } else {
+    ++file_check->mismatches;
+  }
+}
+
+// write data into a pipe and close it
+void write_pipe(const int fd, const std::string* data) {
+  size_t written = 0;
+  while (written < data->size()) {
+    const ssize_t count = write(fd, data->c_str() + written,
+                                data->size() - written);
+    if (count <= 0) {
+      break;
+    }
+    written += static_cast<size_t>(count);
+  }
+  close(fd);
+}
+
+void test_scan_file() {
+  lw::lw_scanner_program_t lw;
+  lw.add_regex("abc", "UTF-8", false, false, &file_check_function<0>);
+  lw.add_regex("bc", "UTF-8", false, false, &file_check_function<1>);
+  lw.add_regex("cab", "UTF-8", false, false, &file_check_function<2>);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+
+  const std::string filename = "temp_scan_file";
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  out << data;
+  out.close();
+
+  file_check_t file_check;
+  lw::lw_scanner_t lw_scanner(lw, &file_check);
+  file_check.lw_scanner = &lw_scanner;
+  TEST_EQ(lw_scanner.scan_file(filename), "");
+  TEST_EQ(file_check.matches, 899);
+  TEST_EQ(file_check.mismatches, 0);
+  TEST_EQ((lw_scanner.read_file_data(0, 1) == nullptr), true);
+  std::remove(filename.c_str());
+
+  // missing file
+  TEST_EQ(lw_scanner.scan_file(filename).empty(), false);
+
+  // a pipe cannot be mapped so it is read
+  int fds[2];
+  TEST_EQ(pipe(fds), 0);
+  TEST_EQ(write(fds[1], data.c_str(), data.size()), (ssize_t)data.size());
+  close(fds[1]);
+  file_check.matches = 0;
+  TEST_EQ(lw_scanner.scan_fd(fds[0]), "");
+  close(fds[0]);
+  TEST_EQ(file_check.matches, 899);
+  TEST_EQ(file_check.mismatches, 0);
+
+  // hits held by the hit filter are reported by scan_finalize, after the
+  // pipe has been read in several blocks
+  std::string piped_data;
+  for (int i = 0; i < 100; ++i) {
+    piped_data += data;
+  }
+  lw::lw_scanner_program_t collect_lw;
+  add_collect_regexes(collect_lw);
+  collect_lw.finalize_program(false);
+  const size_t piped_hits = expected_hits(collect_lw, piped_data).size();
+  TEST_EQ(lw_scanner.set_hit_filter(lw::LW_FILTER_DUPLICATES, 1 << 30), "");
+  TEST_EQ(pipe(fds), 0);
+  std::thread writer(write_pipe, fds[1], &piped_data);
+  file_check.matches = 0;
+  TEST_EQ(lw_scanner.scan_fd(fds[0]), "");
+  writer.join();
+  close(fds[0]);
+  TEST_EQ(file_check.matches, piped_hits);
+  TEST_EQ(file_check.mismatches, 0);
+}
+
+void test_program_cache() {
+  const std::string filename = "temp_program_cache";
+  const std::string data = test_data();
+  std::vector<lw::lw_regex_spec_t> specs = {
+    {"abc", "UTF-8", false, false, &collect_function1},
+    {"bc", "UTF-8", false, false, &collect_function2},
+    {"cab", "UTF-8", false, false, &collect_function3}};
+
+  // save a compiled program
+  hit_list_t expected;
+  {
+    lw::lw_scanner_program_t lw;
+    TEST_EQ(lw.save(filename).empty(), false);
+    add_collect_regexes(lw);
+    lw.finalize_program(false);
+    TEST_EQ(lw.save(filename), "");
+    expected = expected_hits(lw, data);
+
+    // concurrent saves to the same file do not collide
+    std::vector<std::string> errors(4);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < errors.size(); ++i) {
+      threads.push_back(std::thread([&lw, &filename, &errors, i]() {
+        for (int j = 0; j < 20 && errors[i].empty(); ++j) {
+          errors[i] = lw.save(filename);
+        }
+      }));
+    }
+    for (auto it = threads.begin(); it != threads.end(); ++it) {
+      it->join();
+    }
+    for (auto it = errors.begin(); it != errors.end(); ++it) {
+      TEST_EQ(*it, "");
+    }
+  }
+
+  // mismatched definitions or options are rejected
+  {
+    lw::lw_scanner_program_t lw;
+    TEST_EQ(lw.load(filename, specs, true).empty(), false);
+    std::vector<lw::lw_regex_spec_t> other_specs(specs);
+    other_specs[1].is_case_insensitive = true;
+    TEST_EQ(lw.load(filename, other_specs, false).empty(), false);
+    TEST_EQ(lw.load("no_such_file", specs, false).empty(), false);
+  }
+
+  // load and scan
+  lw::lw_scanner_program_t lw;
+  TEST_EQ(lw.load(filename, specs, false), "");
+  std::remove(filename.c_str());
+  TEST_EQ((expected_hits(lw, data) == expected), true);
+}
+
+// check match data read from the ring buffer during push
+class stream_check_t {
+  private:
+  // do not allow copy or assignment
+  stream_check_t(const stream_check_t&) = delete;
+  stream_check_t& operator=(const stream_check_t&) = delete;
+
+  public:
+  const std::string data;
+  lw::lw_stream_scanner_t* stream_scanner;
+  size_t matches;
+  size_t mismatches;
+  stream_check_t(const std::string& p_data) : data(p_data),
+                 stream_scanner(nullptr), matches(0), mismatches(0) {
+  }
+};
+
+template <int N>
+void stream_check_function(const uint64_t start,
+                           const uint64_t size,
+                           void* p_stream_check) {
+  const char* names[] = {"abc", "bc", "cab"};
+  stream_check_t* stream_check(static_cast<stream_check_t*>(p_stream_check));
+  const std::string match = stream_check->stream_scanner->read(start, size, 0);
+
+  // the padding before the match is available
+  const std::string padded = stream_check->stream_scanner->read(start, size,
+                                                                2);
+  const size_t before = (start < 2) ? start : 2;
+  if (match == names[N] &&
+      padded.substr(0, before + size) ==
+      stream_check->data.substr(start - before, before + size)) {
+    ++stream_check->matches;
+  } else {
+    ++stream_check->mismatches;
+  }
+}
+
+void test_stream_scanner() {
+  lw::lw_scanner_program_t lw;
+  lw.add_regex("abc", "UTF-8", false, false, &stream_check_function<0>);
+  lw.add_regex("bc", "UTF-8", false, false, &stream_check_function<1>);
+  lw.add_regex("cab", "UTF-8", false, false, &stream_check_function<2>);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+
+  // push in pieces smaller than a match plus padding
+  stream_check_t stream_check(data);
+  lw::lw_stream_scanner_t stream_scanner(lw, &stream_check, 5);
+  stream_check.stream_scanner = &stream_scanner;
+  TEST_EQ(stream_scanner.program_is_finalized, true);
+  for (size_t i = 0; i < data.size(); i += 2) {
+    stream_scanner.push(data.c_str() + i,
+                        (data.size() - i < 2) ? data.size() - i : 2);
+  }
+  TEST_EQ(stream_scanner.stream_offset(), data.size());
+  stream_scanner.finalize();
+  TEST_EQ(stream_scanner.stream_offset(), 0);
+  TEST_EQ(stream_check.matches, 899);
+  TEST_EQ(stream_check.mismatches, 0);
+
+  // the ring buffer keeps only the last 5 bytes
+  stream_scanner.push(data.c_str(), 12);
+  TEST_EQ(stream_scanner.read(0, 12, 0), data.substr(7, 5));
+  TEST_EQ(stream_scanner.read(10, 1, 1), data.substr(9, 3));
+  stream_scanner.finalize();
+}
+
+void test_scan_stats() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+
+  hit_list_t hit_list;
+  lw::lw_scanner_t lw_scanner(lw, &hit_list);
+
+  // statistics are off by default
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(lw_scanner.stats().bytes_scanned, 0);
+
+  // count and time
+  lw_scanner.enable_stats(true);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  lw::lw_scan_stats_t stats = lw_scanner.stats();
+  TEST_EQ(stats.hit_counts.size(), 3);
+  TEST_EQ(stats.hit_counts[0], 400);
+  TEST_EQ(stats.hit_counts[1], 400);
+  TEST_EQ(stats.hit_counts[2], 99);
+  TEST_EQ(stats.bytes_scanned, data.size());
+  TEST_EQ((stats.search_nanoseconds >= stats.callback_nanoseconds), true);
+  TEST_EQ(hit_list.size(), 2 * 899);
+
+  // statistics work with batches
+  batches_t batches;
+  lw::lw_scanner_t batch_scanner(lw, &batches);
+  batch_scanner.enable_stats(false);
+  batch_scanner.set_batch_callback(batch_function, 10);
+  batch_scanner.scan(0, data.c_str(), data.size());
+  batch_scanner.scan_finalize();
+  TEST_EQ(batches.hit_list.size(), 899);
+  TEST_EQ(batch_scanner.stats().callback_nanoseconds, 0);
+
+  // merge
+  stats.merge(batch_scanner.stats());
+  TEST_EQ(stats.hit_counts[2], 2 * 99);
+  TEST_EQ(stats.bytes_scanned, 2 * data.size());
+
+  // reset
+  lw_scanner.reset_stats();
+  TEST_EQ(lw_scanner.stats().hit_counts[0], 0);
+  TEST_EQ(lw_scanner.stats().hit_counts.size(), 3);
+}
+
+void discard_records(const lw::lw_hit_record_t*, const size_t, void*) {
+}
+
+void count_function(const uint64_t start, const uint64_t size,
+                    void* p_count) {
+  ++*static_cast<size_t*>(p_count);
+}
+
+void count_batch_function(const lw::lw_hit_t*, const size_t count,
+                          void* p_count) {
+  *static_cast<size_t*>(p_count) += count;
+}
+
+void test_scanner_pool() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  const hit_list_t expected = expected_hits(lw, data);
+
+  lw::lw_scanner_pool_t pool(lw, 2);
+  TEST_EQ(pool.program_is_finalized, true);
+  TEST_EQ(pool.size(), 2);
+  {
+    // a partial scan is discarded when the scanner is reused
+    hit_list_t hit_list;
+    lw::lw_scanner_lease_t lease = pool.acquire(&hit_list);
+    lease->enable_stats(false);
+    lease->scan(0, data.c_str(), 14);
+  }
+  {
+    // scanners are reused and bound to new user data
+    hit_list_t hit_list1;
+    hit_list_t hit_list2;
+    hit_list_t hit_list3;
+    lw::lw_scanner_lease_t lease1 = pool.acquire(&hit_list1);
+    lw::lw_scanner_lease_t lease2 = pool.acquire(&hit_list2);
+    TEST_EQ(pool.size(), 2);
+    lw::lw_scanner_lease_t lease3 = pool.acquire(&hit_list3);
+    TEST_EQ(pool.size(), 3);
+    lease1->scan(0, data.c_str() + 14, data.size() - 14);
+    lease1->scan_finalize();
+    TEST_EQ(lease1->stats().bytes_scanned, 0);
+    std::sort(hit_list1.begin(), hit_list1.end());
+    TEST_EQ((hit_list1 == expected_hits(lw, data.substr(14))), true);
+    (*lease2).scan(0, data.c_str(), data.size());
+    lease2->scan_finalize();
+    std::sort(hit_list2.begin(), hit_list2.end());
+    TEST_EQ((hit_list2 == expected), true);
+    TEST_EQ(hit_list3.size(), 0);
+  }
+  TEST_EQ(pool.size(), 3);
+
+  // hit modes set during a lease do not carry over to the next lease
+  lw::lw_scanner_pool_t pool1(lw, 1);
+  {
+    lw::lw_scanner_lease_t lease = pool1.acquire(nullptr);
+    lease->set_record_callback(&discard_records, 2, 2, 0);
+    TEST_EQ(lease->set_hit_filter(lw::LW_FILTER_CONTAINED, 16), "");
+    lease->set_hit_limits(1, 0);
+    TEST_EQ(lease->set_run_skipping(1024, 16), "");
+  }
+  {
+    const std::string runs = data + std::string(4096, 'z') + data;
+    hit_list_t hit_list;
+    lw::lw_scanner_lease_t lease = pool1.acquire(&hit_list);
+    TEST_EQ(pool1.size(), 1);
+    lease->enable_stats(false);
+    lease->scan(0, runs.c_str(), runs.size());
+    lease->scan_finalize();
+    std::sort(hit_list.begin(), hit_list.end());
+    TEST_EQ((hit_list == expected_hits(lw, runs)), true);
+    TEST_EQ(lease->stats().bytes_skipped, 0);
+    TEST_EQ(lease->is_stopped(), false);
+  }
+
+  // hits held from an unfinished scan are not delivered on release
+  lw::lw_scanner_program_t counted;
+  counted.add_regex("abc", "UTF-8", false, false, &count_function);
+  counted.finalize_program(false);
+  lw::lw_scanner_pool_t counted_pool(counted, 1);
+  size_t count = 0;
+  {
+    lw::lw_scanner_lease_t lease = counted_pool.acquire(&count);
+    lease->set_batch_callback(&count_batch_function, 1000);
+    TEST_EQ(lease->set_hit_filter(lw::LW_FILTER_DUPLICATES, 1 << 30), "");
+    lease->scan(0, data.c_str(), data.size());
+  }
+  TEST_EQ(count, 0);
+}
+
+void test_add_regexes() {
+  const std::string data = test_data();
+  std::vector<lw::lw_regex_spec_t> specs = {
+    {"abc", "UTF-8", false, false, &collect_function1},
+    {"", "UTF-8", false, false, &collect_function1},
+    {"bc", "UTF-8", false, false, &collect_function2},
+    {"cab", "UTF-8", false, false, &collect_function3}};
+
+  lw::lw_scanner_program_t lw1;
+  add_collect_regexes(lw1);
+  lw::lw_scanner_program_t lw2;
+  const std::string errors = lw2.add_regexes(specs, 3);
+  TEST_EQ(std::count(errors.begin(), errors.end(), '\n'), 1);
+
+  // finalize both concurrently
+  std::vector<lw::lw_scanner_program_t*> programs = {&lw1, &lw2};
+  lw::lw_scanner_program_t::finalize_programs(programs, false, 2);
+  TEST_EQ((expected_hits(lw2, data) == expected_hits(lw1, data)), true);
+
+  // the programs are interchangeable
+  const std::string filename = "temp_add_regexes";
+  TEST_EQ(lw2.save(filename), "");
+  specs.erase(specs.begin() + 1);
+  lw::lw_scanner_program_t lw3;
+  TEST_EQ(lw3.load(filename, specs, false), "");
+  std::remove(filename.c_str());
+
+  // finalized programs do not accept more regexes
+  TEST_EQ(lw2.add_regexes(specs, 1).empty(), false);
+}
+
+void test_sharded_program() {
+  const std::string data = test_data();
+  std::vector<lw::lw_regex_spec_t> specs = {
+    {"abc", "UTF-8", false, false, &collect_function1},
+    {"bc", "UTF-8", false, false, &collect_function2},
+    {"cab", "UTF-8", false, false, &collect_function3}};
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const hit_list_t expected = expected_hits(lw, data);
+
+  lw::lw_sharded_program_t sharded_program(4);
+  TEST_EQ(sharded_program.add_regexes(specs), "");
+  TEST_EQ(sharded_program.add_regexes(specs).empty(), false);
+  TEST_EQ(sharded_program.shard_count(), 4);
+  sharded_program.finalize_program(false, 2);
+
+  // sequential and threaded shard scans find the same hits
+  for (int is_threaded = 0; is_threaded < 2; ++is_threaded) {
+    hit_list_t hit_list;
+    lw::lw_sharded_scanner_t scanner(sharded_program, &hit_list,
+                                     is_threaded != 0);
+    TEST_EQ(scanner.program_is_finalized, true);
+    scanner.scan(0, data.c_str(), 100);
+    scanner.scan(100, data.c_str() + 100, data.size() - 100);
+    scanner.scan_finalize();
+    std::sort(hit_list.begin(), hit_list.end());
+    TEST_EQ((hit_list == expected), true);
+  }
+
+  // the threaded workers serve many small scans
+  hit_list_t chunked_hit_list;
+  {
+    lw::lw_sharded_scanner_t scanner(sharded_program, &chunked_hit_list,
+                                     true);
+    for (size_t offset = 0; offset < data.size(); offset += 7) {
+      scanner.scan(offset, data.c_str() + offset,
+                   std::min<size_t>(7, data.size() - offset));
+    }
+    scanner.scan_finalize();
+  }
+  std::sort(chunked_hit_list.begin(), chunked_hit_list.end());
+  TEST_EQ((chunked_hit_list == expected), true);
+
+  // batches have original pattern indices
+  batches_t batches;
+  lw::lw_sharded_scanner_t scanner(sharded_program, &batches, true);
+  scanner.set_batch_callback(batch_function);
+  scanner.scan(0, data.c_str(), data.size());
+  scanner.scan_finalize();
+  TEST_EQ(batches.batch_sizes.size(), 1);
+  std::sort(batches.hit_list.begin(), batches.hit_list.end());
+  TEST_EQ((batches.hit_list == expected), true);
+}
+
+void test_scan_pipeline() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  const hit_list_t expected = expected_hits(lw, data);
+
+  const std::string filename = "temp_scan_pipeline";
+  std::ofstream out(filename.c_str(), std::ios::binary);
+  out << data;
+  out.close();
+
+  // small chunks and few buffers exercise fences and backpressure
+  batches_t batches;
+  lw::lw_scan_pipeline_t pipeline(lw, batch_function, &batches,
+                                  3, 97, 8, 4);
+  TEST_EQ(pipeline.scan_file(filename), "");
+  std::sort(batches.hit_list.begin(), batches.hit_list.end());
+  TEST_EQ((batches.hit_list == expected), true);
+  std::remove(filename.c_str());
+
+  // missing file
+  TEST_EQ(pipeline.scan_file(filename).empty(), false);
+
+  // a pipe is read sequentially
+  int fds[2];
+  TEST_EQ(pipe(fds), 0);
+  TEST_EQ(write(fds[1], data.c_str(), data.size()), (ssize_t)data.size());
+  close(fds[1]);
+  batches_t pipe_batches;
+  lw::lw_scan_pipeline_t pipe_pipeline(lw, batch_function, &pipe_batches,
+                                       1, 1000, 8, 3);
+  TEST_EQ(pipe_pipeline.scan_fd(fds[0]), "");
+  close(fds[0]);
+  std::sort(pipe_batches.hit_list.begin(), pipe_batches.hit_list.end());
+  TEST_EQ((pipe_batches.hit_list == expected), true);
+
+  // an unfinalized program is rejected
+  lw::lw_scanner_program_t unfinalized_lw;
+  lw::lw_scan_pipeline_t unfinalized_pipeline(unfinalized_lw, batch_function,
+                                              &pipe_batches, 1, 1000, 8, 3);
+  TEST_EQ(unfinalized_pipeline.program_is_finalized, false);
+  TEST_EQ(unfinalized_pipeline.scan_fd(0).empty(), false);
+}
+
+void test_c_api() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  const hit_list_t expected = expected_hits(lw, data);
+  const char* names[] = {"abc", "bc", "cab"};
+
+  lw_c_program_t* program = lw_program_new();
+  TEST_EQ(lw_program_add(program, "abc", "UTF-8", 0, 0), 0);
+  TEST_EQ(lw_program_add(program, "bc", "UTF-8", 0, 0), 1);
+  TEST_EQ(lw_program_add(program, "cab", "UTF-8", 0, 0), 2);
+  TEST_EQ(lw_program_add(program, "(", "UTF-8", 0, 0), -1);
+  TEST_EQ(std::string(lw_program_error(program)).empty(), false);
+  TEST_EQ((lw_scanner_new(program) == nullptr), true);
+  TEST_EQ(lw_program_finalize(program, 0), 0);
+  TEST_EQ(lw_program_finalize(program, 0), -1);
+  TEST_EQ(lw_program_add(program, "x", "UTF-8", 0, 0), -1);
+
+  // a small hit array leaves hits to take
+  lw_c_scanner_t* scanner = lw_scanner_new(program);
+  lw_c_hit_t hits[100];
+  hit_list_t hit_list;
+  size_t count = lw_scan_buffer_into(scanner, 0, data.c_str(), 700, 0,
+                                     hits, 100);
+  TEST_EQ(count, 100);
+  while (count != 0) {
+    for (size_t i = 0; i < count; ++i) {
+      collect(names[hits[i].pattern_index], hits[i].start, hits[i].size,
+              &hit_list);
+    }
+    count = lw_scanner_take_hits(scanner, hits, 100);
+  }
+  TEST_EQ(lw_scanner_pending_hits(scanner), 0);
+  count = lw_scan_buffer_into(scanner, 700, data.c_str() + 700,
+                              data.size() - 700, 1, hits, 100);
+  while (count != 0) {
+    for (size_t i = 0; i < count; ++i) {
+      collect(names[hits[i].pattern_index], hits[i].start, hits[i].size,
+              &hit_list);
+    }
+    count = lw_scanner_take_hits(scanner, hits, 100);
+  }
+  std::sort(hit_list.begin(), hit_list.end());
+  TEST_EQ((hit_list == expected), true);
+
+  // a large enough hit array receives every hit in one call
+  std::vector<lw_c_hit_t> all_hits(expected.size() + 10);
+  count = lw_scan_buffer_into(scanner, 0, data.c_str(), data.size(), 1,
+                              all_hits.data(), all_hits.size());
+  TEST_EQ(count, expected.size());
+  TEST_EQ(lw_scanner_pending_hits(scanner), 0);
+  hit_list.clear();
+  for (size_t i = 0; i < count; ++i) {
+    collect(names[all_hits[i].pattern_index], all_hits[i].start,
+            all_hits[i].size, &hit_list);
+  }
+  std::sort(hit_list.begin(), hit_list.end());
+  TEST_EQ((hit_list == expected), true);
+
+  // reset discards hits not taken
+  lw_scan_buffer_into(scanner, 0, data.c_str(), data.size(), 1, hits, 1);
+  TEST_EQ((lw_scanner_pending_hits(scanner) > 0), true);
+  lw_scanner_reset(scanner);
+  TEST_EQ(lw_scanner_pending_hits(scanner), 0);
+
+  lw_scanner_free(scanner);
+  lw_program_free(program);
+}
+
+void hit_vector_function(const lw::lw_hit_t* hits,
+                         const size_t count,
+                         void* p_hits) {
+  std::vector<lw::lw_hit_t>* hit_vector(
+                         static_cast<std::vector<lw::lw_hit_t>*>(p_hits));
+  hit_vector->insert(hit_vector->end(), hits, hits + count);
+}
+
+void test_multi_encoding() {
+  lw::lw_scanner_program_t lw;
+  std::vector<std::string> encodings = {"UTF-8", "UTF-16LE", "UTF-16BE"};
+  TEST_EQ(lw.add_regex("abc", std::vector<std::string>(), false, false,
+                       &count_function).empty(), false);
+  TEST_EQ(lw.logical_pattern_count(), 0);
+  TEST_EQ(lw.add_regex("abc", encodings, false, false, &count_function),
+          "");
+  encodings = {"UTF-8", "bad"};
+  TEST_EQ(lw.add_regex("cab", encodings, false, false,
+                       &count_function).empty(), false);
+  TEST_EQ(lw.logical_pattern_count(), 2);
+  TEST_EQ(lw.logical_pattern_index(2), 0);
+  TEST_EQ(lw.logical_pattern_index(3), 1);
+  TEST_EQ(lw.pattern_encoding(1), "UTF-16LE");
+  lw.finalize_program(false);
+
+  const std::string data("abca\0b\0c\0\0a\0b\0ccab", 18);
+
+  // one callback slot per logical pattern
+  size_t count = 0;
+  lw::lw_scanner_t count_scanner(lw, &count);
+  count_scanner.scan(0, data.c_str(), data.size());
+  count_scanner.scan_finalize();
+  TEST_EQ(count, 4);
+
+  // batches report the encoding-specific and logical indices
+  std::vector<lw::lw_hit_t> hits;
+  lw::lw_scanner_t lw_scanner(lw, &hits);
+  lw_scanner.set_batch_callback(hit_vector_function, 0);
+  lw_scanner.enable_stats(false);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(hits.size(), 4);
+  TEST_EQ(hits[0].start, 0);
+  TEST_EQ(hits[0].pattern_index, 0);
+  TEST_EQ(hits[1].start, 3);
+  TEST_EQ(hits[1].pattern_index, 1);
+  TEST_EQ(hits[1].logical_index, 0);
+  TEST_EQ(lw.pattern_encoding(hits[2].pattern_index), "UTF-16BE");
+  TEST_EQ(hits[2].logical_index, 0);
+  TEST_EQ(hits[3].start, 15);
+  TEST_EQ(hits[3].logical_index, 1);
+
+  // statistics are kept per encoding
+  TEST_EQ(lw_scanner.stats().hit_counts.size(), 4);
+  TEST_EQ(lw_scanner.stats().hit_counts[2], 1);
+
+  // saved programs load with their logical patterns
+  const std::string filename = "temp_multi_encoding";
+  TEST_EQ(lw.save(filename), "");
+  std::vector<lw::lw_regex_spec_t> specs = {
+    {"abc", "UTF-8", false, false, &count_function},
+    {"abc", "UTF-16LE", false, false, &count_function},
+    {"abc", "UTF-16BE", false, false, &count_function},
+    {"cab", "UTF-8", false, false, &count_function}};
+  lw::lw_scanner_program_t loaded;
+  TEST_EQ(loaded.load(filename, specs, false), "");
+  std::remove(filename.c_str());
+  TEST_EQ(loaded.logical_pattern_count(), 2);
+  TEST_EQ(loaded.logical_pattern_index(2), 0);
+  TEST_EQ(loaded.logical_pattern_index(3), 1);
+  TEST_EQ(loaded.pattern_encoding(2), "UTF-16BE");
+  std::vector<lw::lw_hit_t> loaded_hits;
+  lw::lw_scanner_t loaded_scanner(loaded, &loaded_hits);
+  loaded_scanner.set_batch_callback(hit_vector_function, 0);
+  loaded_scanner.scan(0, data.c_str(), data.size());
+  loaded_scanner.scan_finalize();
+  TEST_EQ(loaded_hits.size(), 4);
+  TEST_EQ(loaded_hits[2].pattern_index, 2);
+  TEST_EQ(loaded_hits[2].logical_index, 0);
+  TEST_EQ(loaded_hits[3].logical_index, 1);
+  size_t loaded_count = 0;
+  lw::lw_scanner_t loaded_count_scanner(loaded, &loaded_count);
+  loaded_count_scanner.scan(0, data.c_str(), data.size());
+  loaded_count_scanner.scan_finalize();
+  TEST_EQ(loaded_count, 4);
+}
+
+void test_hit_filter() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  const hit_list_t expected = expected_hits(lw, data);
+
+  // overlapping windows report hits twice unless duplicates are dropped
+  for (int is_filtered = 0; is_filtered < 2; ++is_filtered) {
+    hit_list_t hit_list;
+    lw::lw_scanner_t lw_scanner(lw, &hit_list);
+    if (is_filtered) {
+      TEST_EQ(lw_scanner.set_hit_filter(lw::LW_FILTER_DUPLICATES, 32), "");
+    }
+    for (size_t start = 0; start < data.size(); start += 100) {
+      const size_t size = std::min(static_cast<size_t>(120),
+                                   data.size() - start);
+      lw_scanner.scan(start, data.c_str() + start, size);
+    }
+    lw_scanner.scan_finalize();
+    std::sort(hit_list.begin(), hit_list.end());
+    TEST_EQ((hit_list == expected), (is_filtered != 0));
+    TEST_EQ((hit_list.size() > expected.size()), (is_filtered == 0));
+  }
+
+  // a new stream reports hits seen in the previous stream
+  {
+    hit_list_t hit_list;
+    lw::lw_scanner_t lw_scanner(lw, &hit_list);
+    TEST_EQ(lw_scanner.set_hit_filter(lw::LW_FILTER_DUPLICATES, 1 << 30),
+            "");
+    lw_scanner.scan(0, data.c_str(), data.size());
+    lw_scanner.scan_finalize();
+    TEST_EQ(hit_list.size(), expected.size());
+    lw_scanner.scan(0, data.c_str(), data.size());
+    const std::string fence(10, 'z');
+    lw_scanner.scan_fence_finalize(data.size(), fence.c_str(), fence.size());
+    TEST_EQ(hit_list.size(), 2 * expected.size());
+    lw_scanner.scan(0, data.c_str(), data.size());
+    lw_scanner.scan_finalize();
+    TEST_EQ(hit_list.size(), 3 * expected.size());
+  }
+
+  // "bc" always lies inside "abc"
+  std::vector<lw::lw_hit_t> hits;
+  lw::lw_scanner_t lw_scanner(lw, &hits);
+  lw_scanner.set_batch_callback(hit_vector_function, 0);
+  TEST_EQ(lw_scanner.set_hit_filter(8, 16).empty(), false);
+  TEST_EQ(lw_scanner.set_hit_filter(lw::LW_FILTER_CONTAINED, 16), "");
+  lw_scanner.enable_stats(false);
+  lw_scanner.scan(0, data.c_str(), 1000);
+  lw_scanner.scan(1000, data.c_str() + 1000, data.size() - 1000);
+  lw_scanner.scan_finalize();
+  TEST_EQ(hits.size(), 499);
+  TEST_EQ(lw_scanner.stats().hit_counts[1], 0);
+  bool is_ordered = true;
+  for (size_t i = 1; i < hits.size(); ++i) {
+    is_ordered = is_ordered && hits[i - 1].start <= hits[i].start;
+  }
+  TEST_EQ(is_ordered, true);
+
+  // "ab" always starts where a longer "abc" starts
+  lw::lw_scanner_program_t longest_program;
+  longest_program.add_regex("ab", "UTF-8", false, false, &count_function);
+  longest_program.add_regex("abc", "UTF-8", false, false, &count_function);
+  longest_program.finalize_program(false);
+  hits.clear();
+  lw::lw_scanner_t longest_scanner(longest_program, &hits);
+  longest_scanner.set_batch_callback(hit_vector_function, 0);
+  longest_scanner.set_hit_filter(lw::LW_FILTER_LONGEST, 16);
+  longest_scanner.scan(0, data.c_str(), data.size());
+  longest_scanner.scan_finalize();
+  TEST_EQ(hits.size(), 400);
+  TEST_EQ(hits[0].pattern_index, 1);
+
+  // turning the filter off reports every hit again
+  hits.clear();
+  longest_scanner.set_hit_filter(lw::LW_FILTER_NONE, 0);
+  longest_scanner.scan(0, data.c_str(), data.size());
+  longest_scanner.scan_finalize();
+  TEST_EQ(hits.size(), 800);
+}
+
+void test_prefilter() {
+  const std::string data = test_data();
+
+  // literal patterns are prefiltered, other regexes are not
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  TEST_EQ(lw.is_prefiltered(), false);
+  lw.finalize_program(false);
+  TEST_EQ(lw.is_prefiltered(), true);
+  lw::lw_scanner_program_t regex_program;
+  regex_program.add_regex("a.c", "UTF-8", false, false, &count_function);
+  regex_program.finalize_program(false);
+  TEST_EQ(regex_program.is_prefiltered(), false);
+
+  // sparse data with matches across gaps and buffer boundaries
+  std::string sparse(20000, '\0');
+  sparse.replace(0, 3, "abc");
+  sparse.replace(5000, data.size(), data);
+  sparse.replace(9998, 3, "cab");
+  sparse.replace(15000, 3, "xbc");
+  sparse.replace(19997, 3, "abc");
+  hit_list_t hit_list;
+  lw::lw_scanner_t lw_scanner(lw, &hit_list);
+  lw_scanner.scan(0, sparse.c_str(), 9999);
+  lw_scanner.scan(9999, sparse.c_str() + 9999, sparse.size() - 9999);
+  lw_scanner.scan_finalize();
+  // 2 + 899 + 1 + 1 + 2 hits
+  TEST_EQ(hit_list.size(), 905);
+  std::sort(hit_list.begin(), hit_list.end());
+
+  // the same hits as without the prefilter
+  hit_list_t unfiltered;
+  lw::lw_scanner_program_t mixed_program;
+  add_collect_regexes(mixed_program);
+  mixed_program.add_regex("x.x", "UTF-8", false, false, &collect_function1);
+  mixed_program.finalize_program(false);
+  TEST_EQ(mixed_program.is_prefiltered(), false);
+  lw::lw_scanner_t mixed_scanner(mixed_program, &unfiltered);
+  mixed_scanner.scan(0, sparse.c_str(), sparse.size());
+  mixed_scanner.scan_finalize();
+  std::sort(unfiltered.begin(), unfiltered.end());
+  TEST_EQ((hit_list == unfiltered), true);
+
+  // case insensitive UTF-16 patterns
+  lw::lw_scanner_program_t utf16_program;
+  utf16_program.add_regex("ABC", "UTF-16LE", true, true, &count_function);
+  utf16_program.finalize_program(false);
+  TEST_EQ(utf16_program.is_prefiltered(), true);
+  std::string utf16(10000, 'z');
+  utf16.replace(9000, 6, std::string("a\0b\0C\0", 6));
+  size_t count = 0;
+  lw::lw_scanner_t utf16_scanner(utf16_program, &count);
+  utf16_scanner.scan(0, utf16.c_str(), utf16.size());
+  utf16_scanner.scan_finalize();
+  TEST_EQ(count, 1);
+
+  // case insensitive UTF-8 patterns find the same hits as without the
+  // prefilter, including non-ASCII case folds such as U+212A KELVIN SIGN
+  const std::string kelvin = std::string(1000, 'z') + "\xE2\x84\xAA" "ey" +
+                             std::string(1000, 'z') + "KEY";
+  lw::lw_scanner_program_t folded_program;
+  folded_program.add_regex("key", "UTF-8", true, false, &count_function);
+  folded_program.finalize_program(false);
+  TEST_EQ(folded_program.is_prefiltered(), true);
+  size_t folded_count = 0;
+  lw::lw_scanner_t folded_scanner(folded_program, &folded_count);
+  folded_scanner.scan(0, kelvin.c_str(), kelvin.size());
+  folded_scanner.scan_finalize();
+  lw::lw_scanner_program_t unfolded_program;
+  unfolded_program.add_regex("key", "UTF-8", true, false, &count_function);
+  unfolded_program.add_regex("x.x", "UTF-8", false, false, &count_function);
+  unfolded_program.finalize_program(false);
+  TEST_EQ(unfolded_program.is_prefiltered(), false);
+  size_t unfolded_count = 0;
+  lw::lw_scanner_t unfolded_scanner(unfolded_program, &unfolded_count);
+  unfolded_scanner.scan(0, kelvin.c_str(), kelvin.size());
+  unfolded_scanner.scan_finalize();
+  TEST_EQ(folded_count, unfolded_count);
+  TEST_EQ((folded_count >= 1), true);
+}
+
+void test_run_skipping() {
+  const std::string data = test_data();
+  std::string sparse = data + std::string(10000, '\0') + data +
+                       std::string(3000, 'z');
+
+  // with and without the prefilter
+  for (int is_prefiltered = 0; is_prefiltered < 2; ++is_prefiltered) {
+    lw::lw_scanner_program_t lw;
+    add_collect_regexes(lw);
+    if (!is_prefiltered) {
+      lw.add_regex("x.x", "UTF-8", false, false, &collect_function1);
+    }
+    lw.finalize_program(false);
+    TEST_EQ(lw.is_prefiltered(), (is_prefiltered != 0));
+    const hit_list_t expected = expected_hits(lw, sparse);
+    TEST_EQ(expected.size(), 2 * 899);
+
+    hit_list_t hit_list;
+    lw::lw_scanner_t lw_scanner(lw, &hit_list);
+    TEST_EQ(lw_scanner.set_run_skipping(512, 0).empty(), false);
+    TEST_EQ(lw_scanner.set_run_skipping(1024, 16), "");
+    lw_scanner.enable_stats(false);
+    lw_scanner.scan(0, sparse.c_str(), 5000);
+    lw_scanner.scan(5000, sparse.c_str() + 5000, sparse.size() - 5000);
+    lw_scanner.scan_finalize();
+    std::sort(hit_list.begin(), hit_list.end());
+    TEST_EQ((hit_list == expected), true);
+    TEST_EQ((lw_scanner.stats().bytes_skipped > 8000), true);
+    TEST_EQ(lw_scanner.stats().bytes_scanned, sparse.size());
+  }
+}
+
+class record_check_t {
+  public:
+  std::string data;
+  size_t records;
+  size_t mismatches;
+  size_t full_context;
+  size_t batches;
+  record_check_t(const std::string& p_data) :
+           data(p_data), records(0), mismatches(0), full_context(0),
+           batches(0) {
+  }
+};
+
+void record_function(const lw::lw_hit_record_t* records,
+                     const size_t count,
+                     void* p_record_check) {
+  record_check_t* record_check(static_cast<record_check_t*>(p_record_check));
+  ++record_check->batches;
+  for (size_t i = 0; i < count; ++i) {
+    const lw::lw_hit_record_t& record = records[i];
+    ++record_check->records;
+    if (std::string(record.data, record.data_size) !=
+               record_check->data.substr(record.data_offset,
+                                         record.data_size) ||
+        record.data_offset > record.hit.start ||
+        record.data_offset + record.data_size <
+                                 record.hit.start + record.hit.size) {
+      ++record_check->mismatches;
+    }
+    if (record.data_offset + 2 == record.hit.start &&
+        record.data_size == record.hit.size + 4) {
+      ++record_check->full_context;
+    }
+  }
+}
+
+// count records whose data is not the stream data at data_offset, where
+// the data may be incomplete
+void record_data_function(const lw::lw_hit_record_t* records,
+                          const size_t count,
+                          void* p_record_check) {
+  record_check_t* record_check(static_cast<record_check_t*>(p_record_check));
+  for (size_t i = 0; i < count; ++i) {
+    const lw::lw_hit_record_t& record = records[i];
+    ++record_check->records;
+    if (std::string(record.data, record.data_size) !=
+               record_check->data.substr(record.data_offset,
+                                         record.data_size)) {
+      ++record_check->mismatches;
+    }
+  }
+}
+
+void test_hit_records() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+
+  // matches span the buffers, so context comes from both
+  record_check_t record_check(data);
+  lw::lw_scanner_t lw_scanner(lw, &record_check);
+  lw_scanner.set_record_callback(record_function, 2, 2, 100);
+  lw_scanner.scan(0, data.c_str(), 701);
+  lw_scanner.scan(701, data.c_str() + 701, data.size() - 701);
+  lw_scanner.scan_finalize();
+  TEST_EQ(record_check.records, 899);
+  TEST_EQ(record_check.mismatches, 0);
+  TEST_EQ((record_check.full_context > 800), true);
+  TEST_EQ((record_check.batches >= 9), true);
+
+  // scan_fd reads a pipe into the same block each time, so context
+  // before the block comes from the lookback bytes
+  std::string piped_data;
+  for (int i = 0; i < 100; ++i) {
+    piped_data += data;
+  }
+  record_check_t piped_check(piped_data);
+  lw::lw_scanner_t piped_scanner(lw, &piped_check);
+  piped_scanner.set_record_callback(record_function, 2, 2, 0);
+  TEST_EQ(piped_scanner.set_hit_filter(lw::LW_FILTER_DUPLICATES, 1000), "");
+  int fds[2];
+  TEST_EQ(pipe(fds), 0);
+  std::thread writer(write_pipe, fds[1], &piped_data);
+  TEST_EQ(piped_scanner.scan_fd(fds[0]), "");
+  writer.join();
+  close(fds[0]);
+  TEST_EQ(piped_check.records, expected_hits(lw, piped_data).size());
+  TEST_EQ(piped_check.mismatches, 0);
+
+  // a buffer reused for the next stream range is not used for context
+  record_check_t reused_check(data);
+  lw::lw_scanner_t reused_scanner(lw, &reused_check);
+  reused_scanner.set_record_callback(record_data_function, 8, 0, 0);
+  std::vector<char> block(100);
+  for (size_t offset = 0; offset < data.size(); offset += block.size()) {
+    const size_t size = std::min(block.size(), data.size() - offset);
+    std::memcpy(block.data(), data.c_str() + offset, size);
+    reused_scanner.scan(offset, block.data(), size);
+  }
+  reused_scanner.scan_finalize();
+  TEST_EQ(reused_check.records, 899);
+  TEST_EQ(reused_check.mismatches, 0);
+
+  // one batch per scan call, reusing the arena
+  record_check_t unbounded_check(data);
+  lw_scanner.reset(&unbounded_check);
+  lw_scanner.set_record_callback(record_function, 16, 16, 0);
+  for (int i = 0; i < 3; ++i) {
+    lw_scanner.scan(0, data.c_str(), data.size());
+    lw_scanner.scan_finalize();
+  }
+  TEST_EQ(unbounded_check.records, 3 * 899);
+  TEST_EQ(unbounded_check.mismatches, 0);
+
+  // back to per-pattern callbacks
+  hit_list_t hit_list;
+  lw_scanner.reset(&hit_list);
+  lw_scanner.set_record_callback(nullptr, 0, 0, 0);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(hit_list.size(), 899);
+}
+
+void scan_histogram(const lw::lw_scanner_program_t* lw,
+                    const std::string* data, const size_t start,
+                    const size_t size, lw::lw_hit_histogram_t* histogram) {
+  lw::lw_scanner_t lw_scanner(*lw, histogram);
+  lw_scanner.set_record_callback(lw::lw_hit_histogram_t::record_callback,
+                                 0, 0, 64);
+  lw_scanner.scan(start, data->c_str() + start, size);
+  lw_scanner.scan_finalize();
+}
+
+void test_hit_histogram() {
+  lw::lw_scanner_program_t lw;
+  lw.add_regex("abc", "UTF-8", true, false, &count_function);
+  lw.add_regex("cab", "UTF-8", false, false, &count_function);
+  lw.finalize_program(false);
+  std::string data;
+  for (int i = 0; i < 100; ++i) {
+    data += (i % 4 == 0) ? "ABCx" : (i % 10 == 0) ? "aBcx" : "abcx";
+  }
+
+  // one histogram per thread, merged at the end
+  std::vector<lw::lw_hit_histogram_t> histograms(2,
+                                      lw::lw_hit_histogram_t(true));
+  std::thread thread1(scan_histogram, &lw, &data, 0, 200, &histograms[0]);
+  std::thread thread2(scan_histogram, &lw, &data, 200, 200, &histograms[1]);
+  thread1.join();
+  thread2.join();
+  lw::lw_hit_histogram_t histogram(true);
+  histogram.merge(histograms[0]);
+  histogram.merge(histograms[1]);
+
+  TEST_EQ(histogram.pattern_count(), 1);
+  TEST_EQ(histogram.pattern(0).count, 100);
+  TEST_EQ(histogram.pattern(0).first_offset, 0);
+  TEST_EQ(histogram.pattern(0).last_offset, 396);
+  const std::vector<std::pair<std::string, uint64_t> > top =
+                                         histogram.top_features(0, 2);
+  TEST_EQ(top.size(), 2);
+  TEST_EQ(top[0].first, "abc");
+  TEST_EQ(top[0].second, 70);
+  TEST_EQ(top[1].first, "ABC");
+  TEST_EQ(top[1].second, 25);
+  TEST_EQ(histogram.top_features(0, 10).size(), 3);
+  TEST_EQ(histogram.top_features(1, 10).size(), 0);
+
+  // batches count hits without match data
+  lw::lw_hit_histogram_t batch_histogram(true);
+  lw::lw_scanner_t lw_scanner(lw, &batch_histogram);
+  lw_scanner.set_batch_callback(lw::lw_hit_histogram_t::batch_callback, 0);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(batch_histogram.pattern(0).count, 100);
+  TEST_EQ(batch_histogram.top_features(0, 2).size(), 0);
+}
+
+void test_multistream_scanner() {
+  const std::string data = test_data();
+
+  // with and without the prefilter
+  for (int is_prefiltered = 0; is_prefiltered < 2; ++is_prefiltered) {
+    lw::lw_scanner_program_t lw;
+    add_collect_regexes(lw);
+    if (!is_prefiltered) {
+      lw.add_regex("x.x", "UTF-8", false, false, &collect_function1);
+    }
+    lw.finalize_program(false);
+    const hit_list_t expected = expected_hits(lw, data);
+
+    // interleave small pushes of many streams so matches span switches
+    std::vector<hit_list_t> hit_lists(5);
+    lw::lw_multistream_scanner_t scanner(lw, 8);
+    TEST_EQ(scanner.program_is_finalized, true);
+    std::vector<size_t> stream_ids;
+    for (size_t i = 0; i < hit_lists.size(); ++i) {
+      stream_ids.push_back(scanner.open_stream(&hit_lists[i]));
+    }
+    TEST_EQ(scanner.stream_count(), 5);
+    for (size_t start = 0; start < data.size(); start += 7) {
+      for (size_t i = 0; i < stream_ids.size(); ++i) {
+        const size_t size = std::min(static_cast<size_t>(7),
+                                     data.size() - start);
+        TEST_EQ(scanner.scan(stream_ids[i], data.c_str() + start, size), "");
+      }
+    }
+    TEST_EQ(scanner.stream_offset(stream_ids[2]), data.size());
+    for (size_t i = 0; i < stream_ids.size(); ++i) {
+      TEST_EQ(scanner.finalize(stream_ids[i]), "");
+      std::sort(hit_lists[i].begin(), hit_lists[i].end());
+      TEST_EQ((hit_lists[i] == expected), true);
+    }
+    TEST_EQ(scanner.stream_count(), 0);
+    TEST_EQ(scanner.finalize(stream_ids[0]).empty(), false);
+    TEST_EQ(scanner.scan(99, data.c_str(), 1).empty(), false);
+
+    // stream IDs are reused
+    hit_list_t hit_list;
+    TEST_EQ((scanner.open_stream(&hit_list) < 5), true);
+  }
+}
+
+void test_hit_log() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  const std::string filename = "temp_hit_log";
+
+  // small buffers so the background writer is used many times
+  lw::lw_hit_log_writer_t writer;
+  TEST_EQ(writer.open(filename, 256), "");
+  TEST_EQ(writer.open(filename, 256).empty(), false);
+  lw::lw_scanner_t lw_scanner(lw, &writer);
+  lw_scanner.set_record_callback(lw::lw_hit_log_writer_t::record_callback,
+                                 1, 1, 50);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  lw_scanner.set_record_callback(nullptr, 0, 0, 0);
+  lw_scanner.set_batch_callback(lw::lw_hit_log_writer_t::batch_callback, 0);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(writer.close(), "");
+
+  // read the log back
+  lw::lw_hit_log_reader_t reader;
+  TEST_EQ(reader.open(filename), "");
+  lw::lw_hit_record_t record;
+  hit_list_t hit_list;
+  size_t records = 0;
+  size_t mismatches = 0;
+  const char* names[] = {"abc", "bc", "cab"};
+  while (reader.next(record)) {
+    ++records;
+    if (records <= 899) {
+      if (std::string(record.data, record.data_size) !=
+          data.substr(record.data_offset, record.data_size)) {
+        ++mismatches;
+      }
+      collect(names[record.hit.pattern_index], record.hit.start,
+              record.hit.size, &hit_list);
+    } else if (record.data_size != 0) {
+      ++mismatches;
+    }
+  }
+  reader.close();
+  std::remove(filename.c_str());
+  TEST_EQ(records, 2 * 899);
+  TEST_EQ(mismatches, 0);
+  std::sort(hit_list.begin(), hit_list.end());
+  TEST_EQ((hit_list == expected_hits(lw, data)), true);
+
+  // missing log
+  TEST_EQ(reader.open(filename).empty(), false);
+  TEST_EQ(reader.next(record), false);
+}
+
+void test_hit_limits() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  std::string big_data;
+  for (int i = 0; i < 100; ++i) {
+    big_data += data;
+  }
+
+  hit_list_t hit_list;
+  lw::lw_scanner_t lw_scanner(lw, &hit_list);
+
+  // first hit wins
+  lw_scanner.set_hit_limits(1, 0);
+  lw_scanner.scan(0, big_data.c_str(), big_data.size());
+  TEST_EQ(lw_scanner.is_stopped(), true);
+  lw_scanner.scan(big_data.size(), data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(hit_list.size(), 1);
+  TEST_EQ(hit_list[0], "abc 0 3");
+  TEST_EQ(lw_scanner.is_stopped(), true);
+
+  // counts start over with the next stream
+  hit_list.clear();
+  lw_scanner.set_hit_limits(50, 0);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(hit_list.size(), 50);
+  hit_list.clear();
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(hit_list.size(), 50);
+
+  // per-pattern limits stop once every pattern is capped
+  hit_list.clear();
+  lw_scanner.set_hit_limits(0, 10);
+  lw_scanner.scan(0, big_data.c_str(), big_data.size());
+  TEST_EQ(lw_scanner.is_stopped(), true);
+  lw_scanner.scan_finalize();
+  TEST_EQ(hit_list.size(), 30);
+
+  // a total limit under the per-pattern limits
+  hit_list.clear();
+  lw_scanner.set_hit_limits(5, 10);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(hit_list.size(), 5);
+
+  // reset clears the stopped state
+  lw_scanner.reset(&hit_list);
+  TEST_EQ(lw_scanner.is_stopped(), false);
+
+  // no limits
+  hit_list.clear();
+  lw_scanner.set_hit_limits(0, 0);
+  lw_scanner.scan(0, data.c_str(), data.size());
+  lw_scanner.scan_finalize();
+  TEST_EQ(hit_list.size(), 899);
+  TEST_EQ(lw_scanner.is_stopped(), false);
+
+  // chunks ended by scan_fence_finalize each start over, and the fence
+  // of a stopped chunk is not searched
+  hit_list.clear();
+  lw_scanner.set_hit_limits(1, 0);
+  lw_scanner.enable_stats(false);
+  for (size_t i = 0; i < 2; ++i) {
+    lw_scanner.scan(i * 100, data.c_str() + i * 100, 100);
+    TEST_EQ(lw_scanner.is_stopped(), true);
+    lw_scanner.scan_fence_finalize(i * 100 + 100, data.c_str() + i * 100 + 100,
+                                   100);
+  }
+  TEST_EQ(hit_list.size(), 2);
+  TEST_EQ(lw_scanner.stats().bytes_scanned, 200);
+}
+
+void decoded_hit_function(const lw::lw_decoded_hit_t* hits,
+                          const size_t count, void* p_paths) {
+  std::vector<std::string>* paths =
+                      static_cast<std::vector<std::string>*>(p_paths);
+  for (size_t i = 0; i < count; ++i) {
+    const lw::lw_decoded_hit_t& hit = hits[i];
+    paths->push_back(hit.path + " " +
+                     std::string(hit.data + hit.hit.start, hit.hit.size));
+  }
+}
+
+void test_recursive_scanner() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+
+  // base64 of 50 dots, "cab", and 10 dots at offset 4, and at offset 89,
+  // gzip of "--", base64 of 20 dots, "abc", and 37 dots, then "--"
+  const char gzip_data[] =
+        "\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\xff\xd3\xd5\xf5\xc9\x34\x29"
+        "\xc5\x8e\x4d\x33\x22\x73\x7d\x4b\x71\xcb\x63\xc7\xba\xba\x00\xcd"
+        "\x0f\x9f\xe1\x54\x00\x00\x00";
+  const std::string data = std::string("abc ") +
+        "Li4uLi4uLi4uLi4uLi4uLi4uLi4uLi4uLi4uLi4uLi4uLi4uLi4uLi4uLi4uLi4u"
+        "Li5jYWIuLi4uLi4uLi4u" + " " +
+        std::string(gzip_data, sizeof(gzip_data) - 1) + " end";
+  std::vector<std::string> paths;
+
+  // raw only
+  lw::lw_recursive_scanner_t scanner0(lw, &decoded_hit_function, &paths,
+                                      0, 1000);
+  scanner0.scan(data.c_str(), data.size());
+  TEST_EQ(paths.size(), 2);
+  TEST_EQ(paths[0], "0 abc");
+  TEST_EQ(paths[1], "1 bc");
+  TEST_EQ(scanner0.decoded_bytes(), 0);
+
+  // nested content
+  paths.clear();
+  lw::lw_recursive_scanner_t scanner2(lw, &decoded_hit_function, &paths,
+                                      2, 1000);
+  scanner2.scan(data.c_str(), data.size());
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+  TEST_EQ(paths.size(), 5);
+  TEST_EQ(paths[3], "89-GZIP-2-BASE64-20 abc");
+  TEST_EQ(paths[4], "89-GZIP-2-BASE64-21 bc");
+  TEST_EQ(scanner2.decoded_bytes(), 63 + 84 + 60);
+#else
+  TEST_EQ(paths.size(), 3);
+#endif
+  TEST_EQ(paths[2], "4-BASE64-50 cab");
+
+  // the byte budget stops decoding
+  paths.clear();
+  lw::lw_recursive_scanner_t scanner_budget(lw, &decoded_hit_function,
+                                            &paths, 2, 70);
+  scanner_budget.scan(data.c_str(), data.size());
+  TEST_EQ(paths.size(), 3);
+  TEST_EQ((scanner_budget.decoded_bytes() <= 70), true);
+}
+
+void test_numa_parallel_scanner() {
+  lw::lw_scanner_program_t lw;
+  add_collect_regexes(lw);
+  lw.finalize_program(false);
+  const std::string data = test_data();
+  const hit_list_t expected = expected_hits(lw, data);
+
+  std::vector<hit_list_t> hit_lists(4);
+  std::vector<void*> user_data;
+  for (auto it = hit_lists.begin(); it != hit_lists.end(); ++it) {
+    user_data.push_back(&*it);
+  }
+  lw::lw_parallel_scanner_t parallel_scanner(lw, user_data, 7, 16, true);
+  TEST_EQ((parallel_scanner.numa_node_count() <= user_data.size()), true);
+  if (access("/sys/devices/system/node/node0", F_OK) == 0) {
+    TEST_EQ((parallel_scanner.numa_node_count() > 0), true);
+  }
+
+  // the calling thread's CPUs are restored after scanning
+  cpu_set_t before;
+  cpu_set_t after;
+  TEST_EQ(sched_getaffinity(0, sizeof(before), &before), 0);
+  parallel_scanner.scan(0, data.c_str(), data.size());
+  TEST_EQ(sched_getaffinity(0, sizeof(after), &after), 0);
+  TEST_EQ((CPU_EQUAL(&before, &after) != 0), true);
+
+  hit_list_t hits;
+  for (auto it = hit_lists.begin(); it != hit_lists.end(); ++it) {
+    hits.insert(hits.end(), it->begin(), it->end());
+  }
+  std::sort(hits.begin(), hits.end());
+  TEST_EQ((hits == expected), true);
+}
+
 // should not cause null pointer exception
 void test_is_finalized() {
 
@@ -285,6 +1782,33 @@ void test_read_bounds() {
   TEST_EQ(lw::read_buffer(100, pb, pbs, b, bs, 154,1,50), "");
 }
 
+void test_read_buffer_view() {
+  const char* pb = "12345";
+  const char* b = "6789";
+
+  // span both buffers
+  lw::buffer_view_t view = lw::read_buffer_view(100, pb, 5, b, 4, 99,2,1);
+  TEST_EQ(view.size(), 4);
+  TEST_EQ(std::string(view.first.data, view.first.size), "45");
+  TEST_EQ(std::string(view.second.data, view.second.size), "67");
+
+  // previous buffer only
+  view = lw::read_buffer_view(100, pb, 5, b, 4, 95,2,0);
+  TEST_EQ(std::string(view.first.data, view.first.size), "12");
+  TEST_EQ(view.second.size, 0);
+
+  // out of bounds
+  view = lw::read_buffer_view(100, pb, 5, b, 4, 154,1,50);
+  TEST_EQ(view.size(), 0);
+
+  // reuse a string
+  std::string data("previous contents");
+  lw::read_buffer_into(100, pb, 5, b, 4, 99,50,0, data);
+  TEST_EQ(data, "56789");
+  lw::read_buffer_into(100, pb, 5, b, 4, 104,1,0, data);
+  TEST_EQ(data, "");
+}
+
 // ************************************************************
 // main
 // ************************************************************
@@ -294,6 +1818,30 @@ int main(int argc, char* argv[]) {
   test1();
   test_is_finalized();
   test_read_bounds();
+  test_read_buffer_view();
+  test_parallel_scanner();
+  test_batch_callback();
+  test_basic_scanner();
+  test_scan_file();
+  test_program_cache();
+  test_stream_scanner();
+  test_scan_stats();
+  test_scanner_pool();
+  test_add_regexes();
+  test_sharded_program();
+  test_scan_pipeline();
+  test_c_api();
+  test_multi_encoding();
+  test_hit_filter();
+  test_prefilter();
+  test_run_skipping();
+  test_hit_records();
+  test_hit_histogram();
+  test_multistream_scanner();
+  test_hit_log();
+  test_hit_limits();
+  test_recursive_scanner();
+  test_numa_parallel_scanner();
 
   // done
   std::cout << "Tests Done.\n";